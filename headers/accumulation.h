@@ -0,0 +1,50 @@
+//Running sums of every sample traced into each pixel, for renders that
+//come in passes. Each pixel keeps its own count, so a pass that got cut
+//short still averages out properly. The squared luminance of each
+//sample is kept too, which is enough to tell how noisy a pixel still is.
+//Luminance there stops at 1, since noise in parts that come out white
+//anyway isn't worth more samples.
+struct AccumulationBuffer{
+	u16 width, height;
+	std::vector<glm::vec3> sum;
+	std::vector<float> luminanceSums, luminanceSquares;
+	std::vector<u32> samples;
+
+	AccumulationBuffer(u16 w, u16 h) : width(w), height(h), sum((size_t)w * h, glm::vec3(0.0f)), 
+	luminanceSums((size_t)w * h, 0.0f), luminanceSquares((size_t)w * h, 0.0f), samples((size_t)w * h, 0) {}
+
+	static float luminance(glm::vec3 color){
+		return std::min(glm::dot(color, glm::vec3(0.2126f, 0.7152f, 0.0722f)), 1.0f);
+	}
+
+	void add(int x, int y, glm::vec3 color){
+		u32 index = x + y * width;
+		float lum = luminance(color);
+		sum[index] += color;
+		luminanceSums[index] += lum;
+		luminanceSquares[index] += lum * lum;
+		samples[index]++;
+	}
+
+	//How far the average luminance is likely to be from the real one,
+	//going by the spread of the samples so far. Unknown below two samples.
+	float standardError(u32 index) const{
+		u32 n = samples[index];
+		if(n < 2)
+			return std::numeric_limits<float>::infinity();
+		float mean = luminanceSums[index] / n;
+		float variance = std::max(0.0f, (luminanceSquares[index] - mean * mean * n) / (n - 1));
+		return sqrtf(variance / n);
+	}
+
+	//Black for pixels that haven't been reached yet.
+	glm::vec3 average(u32 index) const{
+		return samples[index] ? sum[index] / (float)samples[index] : glm::vec3(0.0f);
+	}
+
+	uint64_t totalSamples() const{
+		uint64_t total = 0;
+		for(u32 count : samples) total += count;
+		return total;
+	}
+};
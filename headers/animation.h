@@ -0,0 +1,57 @@
+//Keyframed camera and light movement for rendering several frames out
+//of one scene. Anything a keyframe leaves out carries over from the one
+//before it, and frames in between are blended linearly. The still pose
+//is always there as the key for frame 0, so the first keyframe moves
+//away from it instead of holding still until it comes up.
+
+struct Keyframe{
+	u32 frame = 0;
+	glm::vec3 position;
+	float rotation, fov;
+	std::vector<glm::vec3> lights;
+};
+
+struct Animation{
+	std::vector<Keyframe> keys;
+	u32 frameCount = 1;
+	//In hundredths of a second, which is what GIF and our APNGs count in.
+	u16 frameDelay = 4;
+	bool looping = true;
+
+	//A key on a frame that already has one replaces it.
+	void addKey(const Keyframe &key){
+		for(Keyframe &other : keys){
+			if(other.frame == key.frame){
+				other = key;
+				return;
+			}
+		}
+		auto spot = std::upper_bound(keys.begin(), keys.end(), key.frame, [](u32 frame, const Keyframe &other){
+			return frame < other.frame;
+		});
+		keys.insert(spot, key);
+	}
+
+	//Holds the first and last keys outside of their range.
+	Keyframe at(u32 frame) const{
+		if(frame <= keys.front().frame)
+			return keys.front();
+		if(frame >= keys.back().frame)
+			return keys.back();
+
+		u32 next = 1;
+		while(keys[next].frame < frame) next++;
+		const Keyframe &a = keys[next - 1], &b = keys[next];
+		float t = (float)(frame - a.frame) / (b.frame - a.frame);
+
+		Keyframe result = a;
+		result.frame = frame;
+		result.position = glm::mix(a.position, b.position, t);
+		result.rotation = glm::mix(a.rotation, b.rotation, t);
+		result.fov = glm::mix(a.fov, b.fov, t);
+		for(u32 i = 0; i < result.lights.size(); i++){
+			result.lights[i] = glm::mix(a.lights[i], b.lights[i], t);
+		}
+		return result;
+	}
+};
@@ -0,0 +1,198 @@
+//Bounding volume hierarchies, built top-down with a binned surface area
+//heuristic. Every kind of primitive gets its own, built over its own
+//array, and the array is then sorted into leaf order so a leaf is just
+//a run of indices the caller can test however suits that kind best.
+
+struct BVHNode{
+	AABB bounds;
+	u32 leftFirst; //Left child index for inner nodes, first object for leaves.
+	u32 count;     //Zero for inner nodes.
+};
+
+//Top-down binned SAH build. Shared by the scene BVH and the per mesh
+//triangle BVHs: it only sees boxes, and leaves order rearranged so
+//every leaf covers a contiguous run of it.
+constexpr u32 bvhStackSize = 64;
+
+struct BVHBuilder{
+	std::vector<BVHNode> &nodes;
+	std::vector<u32> &order;
+	const std::vector<AABB> &boxes;
+	u32 maxLeafSize;
+	u32 depth = 0;
+
+	static constexpr u32 binCount = 16;
+	static constexpr float traversalCost = 1.0f;
+
+	BVHBuilder(std::vector<BVHNode> &n, std::vector<u32> &o, const std::vector<AABB> &b, u32 leafSize) : nodes(n), order(o), boxes(b), maxLeafSize(leafSize) {}
+
+	void build(){
+		nodes.clear();
+		order.resize(boxes.size());
+		std::iota(order.begin(), order.end(), 0);
+		if(boxes.empty())
+			return;
+
+		nodes.reserve(boxes.size() * 2);
+		nodes.push_back(BVHNode());
+		subdivide(0, 0, boxes.size(), 1);
+		nodes.shrink_to_fit();
+	}
+
+	void subdivide(u32 nodeIndex, u32 first, u32 count, u32 level){
+		depth = std::max(depth, level);
+
+		AABB bounds, centroids;
+		for(u32 i = first; i < first + count; i++){
+			bounds.grow(boxes[order[i]]);
+			centroids.grow(boxes[order[i]].center());
+		}
+		nodes[nodeIndex].bounds = bounds;
+		nodes[nodeIndex].leftFirst = first;
+		nodes[nodeIndex].count = count;
+
+		//The traversal stack never holds more than a node per level.
+		if(count <= maxLeafSize || level >= bvhStackSize - 1)
+			return;
+
+		//Find the cheapest binned split on any axis.
+		float bestCost = std::numeric_limits<float>::max();
+		int bestAxis = -1;
+		u32 bestBin = 0;
+		for(int axis = 0; axis < 3; axis++){
+			float extent = centroids.max[axis] - centroids.min[axis];
+			if(extent <= 0.0f)
+				continue;
+
+			AABB binBoxes[binCount];
+			u32 binCounts[binCount] = {};
+			float scale = binCount / extent;
+			for(u32 i = first; i < first + count; i++){
+				u32 bin = std::min(binCount - 1, (u32)((boxes[order[i]].center()[axis] - centroids.min[axis]) * scale));
+				binBoxes[bin].grow(boxes[order[i]]);
+				binCounts[bin]++;
+			}
+
+			float leftArea[binCount - 1], rightArea[binCount - 1];
+			u32 leftCount[binCount - 1], rightCount[binCount - 1];
+			AABB leftBox, rightBox;
+			u32 leftSum = 0, rightSum = 0;
+			for(u32 i = 0; i < binCount - 1; i++){
+				leftSum += binCounts[i];
+				leftCount[i] = leftSum;
+				leftBox.grow(binBoxes[i]);
+				leftArea[i] = leftBox.halfArea();
+
+				rightSum += binCounts[binCount - 1 - i];
+				rightCount[binCount - 2 - i] = rightSum;
+				rightBox.grow(binBoxes[binCount - 1 - i]);
+				rightArea[binCount - 2 - i] = rightBox.halfArea();
+			}
+
+			for(u32 i = 0; i < binCount - 1; i++){
+				if(leftCount[i] == 0 || rightCount[i] == 0)
+					continue;
+				float cost = leftCount[i] * leftArea[i] + rightCount[i] * rightArea[i];
+				if(cost < bestCost){
+					bestCost = cost;
+					bestAxis = axis;
+					bestBin = i;
+				}
+			}
+		}
+
+		//Splitting is only worth it if it beats testing everything here,
+		//counting the extra box test it costs to walk into the children.
+		if(bestAxis < 0 || bestCost + traversalCost * bounds.halfArea() >= count * bounds.halfArea())
+			return;
+
+		float splitScale = binCount / (centroids.max[bestAxis] - centroids.min[bestAxis]);
+		auto middle = std::partition(order.begin() + first, order.begin() + first + count, [&](u32 index){
+			u32 bin = std::min(binCount - 1, (u32)((boxes[index].center()[bestAxis] - centroids.min[bestAxis]) * splitScale));
+			return bin <= bestBin;
+		});
+		u32 leftCount = middle - (order.begin() + first);
+		if(leftCount == 0 || leftCount == count)
+			return;
+
+		u32 leftIndex = nodes.size();
+		nodes.push_back(BVHNode());
+		nodes.push_back(BVHNode());
+		nodes[nodeIndex].leftFirst = leftIndex;
+		nodes[nodeIndex].count = 0;
+
+		subdivide(leftIndex, first, leftCount, level + 1);
+		subdivide(leftIndex + 1, first + leftCount, count - leftCount, level + 1);
+	}
+};
+
+//Walks the tree and hands every leaf the ray gets to before tMax over
+//to leaf(first, count, tMax). The leaf lowers tMax as it finds closer
+//hits, and returns true to stop the walk right there, which is all an
+//any-hit query needs. Closest hit queries want the nearer child first,
+//any-hit ones don't care. tMax is worked on as a local so it can stay
+//in a register for the whole walk.
+template<bool nearestFirst = true, typename LeafFunc>
+void traverseBVH(const std::vector<BVHNode> &nodes, const Ray &ray, float &tMax, LeafFunc leaf){
+	if(nodes.empty())
+		return;
+
+	float closest = tMax;
+	glm::vec3 invDir = 1.0f / ray.direction;
+	u32 stack[bvhStackSize];
+	u32 stackPtr = 0;
+	stack[stackPtr++] = 0;
+
+	while(stackPtr > 0){
+		const BVHNode &node = nodes[stack[--stackPtr]];
+		if(!node.bounds.hit(ray, invDir, closest))
+			continue;
+
+		if(node.count > 0){
+			threadCounters.intersectionTests += node.count;
+			if(leaf(node.leftFirst, node.count, closest))
+				break;
+			continue;
+		}
+
+		//Push the farther child first so the nearer one gets popped next.
+		u32 left = node.leftFirst, right = node.leftFirst + 1;
+		if(nearestFirst && glm::dot(nodes[left].bounds.center() - nodes[right].bounds.center(), ray.direction) > 0.0f)
+			std::swap(left, right);
+		stack[stackPtr++] = right;
+		stack[stackPtr++] = left;
+	}
+	tMax = closest;
+}
+
+//A BVH over one array of primitives, anything with a getBounds().
+struct PrimitiveBVH{
+	std::vector<BVHNode> nodes;
+	u32 depth = 0;
+
+	//Builds the tree and sorts primitives into leaf order to match.
+	template<typename Primitive>
+	void build(std::vector<Primitive> &primitives, u32 maxLeafSize){
+		std::vector<AABB> boxes(primitives.size());
+		for(u32 i = 0; i < primitives.size(); i++){
+			boxes[i] = primitives[i].getBounds();
+		}
+
+		std::vector<u32> order;
+		BVHBuilder builder(nodes, order, boxes, maxLeafSize);
+		builder.build();
+		depth = builder.depth;
+
+		std::vector<Primitive> sorted;
+		sorted.reserve(primitives.size());
+		for(u32 index : order){
+			sorted.push_back(std::move(primitives[index]));
+		}
+		primitives = std::move(sorted);
+	}
+
+	template<bool nearestFirst = true, typename LeafFunc>
+	void traverse(const Ray &ray, float &tMax, LeafFunc leaf) const{
+		traverseBVH<nearestFirst>(nodes, ray, tMax, leaf);
+	}
+};
@@ -4,6 +4,11 @@
 #include <fstream>
 #include <limits>
 #include <cstdint>
+#include <atomic>
+#include <memory>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
 
 //This header also implements the Knoll-Yilluoma dither algorithm
 //as described in Biqswit's article here:
@@ -43,20 +48,391 @@ struct TrueColor{
     }
 };
 
+//Colors are indices into the palette. A mixRatio of 4 means a tri-tone
+//plan, which lays its colors out in a 2x2 pattern instead of following
+//the dither matrix.
 struct MixPlan{
-    TrueColor colors[4];
-    double mixRatio;
+    uint8_t colors[4];
+    float mixRatio;
 };
 
+//A batch of colors as separate float channels, for working out one
+//color's distance to all of them in a few vector instructions. The
+//arrays are padded so the last vector never reads past the end.
+struct ColorBatch{
+    static constexpr uint32_t capacity = 256 + 8;
+    alignas(32) float R[capacity], G[capacity], B[capacity];
+    uint32_t count = 0;
+
+    ColorBatch(){
+        std::fill(R, R + capacity, 0.0f);
+        std::fill(G, G + capacity, 0.0f);
+        std::fill(B, B + capacity, 0.0f);
+    }
+
+    void set(uint32_t index, TrueColor color){
+        R[index] = color.R;
+        G[index] = color.G;
+        B[index] = color.B;
+    }
+};
+
+//TrueColor::distCompare from target to every color in the batch, in
+//float. out needs room for the batch rounded up to a whole vector.
+void distanceBatch(TrueColor target, const ColorBatch &batch, float *out){
+    constexpr float scale = 1.0f / (255.0f * 255.0f);
+    uint32_t i = 0;
+#if defined(__AVX2__)
+    __m256 tr = _mm256_set1_ps(target.R), tg = _mm256_set1_ps(target.G), tb = _mm256_set1_ps(target.B);
+    __m256 wr = _mm256_set1_ps(0.299f), wg = _mm256_set1_ps(0.587f), wb = _mm256_set1_ps(0.114f);
+    __m256 chroma = _mm256_set1_ps(0.75f), scaling = _mm256_set1_ps(scale);
+    for(; i < batch.count; i += 8){
+        __m256 dr = _mm256_sub_ps(tr, _mm256_load_ps(&batch.R[i]));
+        __m256 dg = _mm256_sub_ps(tg, _mm256_load_ps(&batch.G[i]));
+        __m256 db = _mm256_sub_ps(tb, _mm256_load_ps(&batch.B[i]));
+        __m256 weighted = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wr, _mm256_mul_ps(dr, dr)), _mm256_mul_ps(wg, _mm256_mul_ps(dg, dg))), _mm256_mul_ps(wb, _mm256_mul_ps(db, db)));
+        __m256 luma = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(wr, dr), _mm256_mul_ps(wg, dg)), _mm256_mul_ps(wb, db));
+        __m256 dist = _mm256_add_ps(_mm256_mul_ps(chroma, weighted), _mm256_mul_ps(luma, luma));
+        _mm256_storeu_ps(&out[i], _mm256_mul_ps(dist, scaling));
+    }
+#elif defined(__SSE2__)
+    __m128 tr = _mm_set1_ps(target.R), tg = _mm_set1_ps(target.G), tb = _mm_set1_ps(target.B);
+    __m128 wr = _mm_set1_ps(0.299f), wg = _mm_set1_ps(0.587f), wb = _mm_set1_ps(0.114f);
+    __m128 chroma = _mm_set1_ps(0.75f), scaling = _mm_set1_ps(scale);
+    for(; i < batch.count; i += 4){
+        __m128 dr = _mm_sub_ps(tr, _mm_load_ps(&batch.R[i]));
+        __m128 dg = _mm_sub_ps(tg, _mm_load_ps(&batch.G[i]));
+        __m128 db = _mm_sub_ps(tb, _mm_load_ps(&batch.B[i]));
+        __m128 weighted = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wr, _mm_mul_ps(dr, dr)), _mm_mul_ps(wg, _mm_mul_ps(dg, dg))), _mm_mul_ps(wb, _mm_mul_ps(db, db)));
+        __m128 luma = _mm_add_ps(_mm_add_ps(_mm_mul_ps(wr, dr), _mm_mul_ps(wg, dg)), _mm_mul_ps(wb, db));
+        __m128 dist = _mm_add_ps(_mm_mul_ps(chroma, weighted), _mm_mul_ps(luma, luma));
+        _mm_storeu_ps(&out[i], _mm_mul_ps(dist, scaling));
+    }
+#else
+    for(; i < batch.count; i++){
+        float dr = target.R - batch.R[i], dg = target.G - batch.G[i], db = target.B - batch.B[i];
+        float luma = 0.299f * dr + 0.587f * dg + 0.114f * db;
+        out[i] = (0.75f * (0.299f * dr * dr + 0.587f * dg * dg + 0.114f * db * db) + luma * luma) * scale;
+    }
+#endif
+}
+
+//TrueColor::mixingPenalty for a batch of two color mixes, where mix i
+//sits ratios[i] of the way between its two colors, and those two are
+//pairDistances[i] apart.
+void mixingPenaltyBatch(TrueColor target, const ColorBatch &mixes, const float *pairDistances, const float *ratios, float *out){
+    distanceBatch(target, mixes, out);
+    for(uint32_t i = 0; i < mixes.count; i++){
+        out[i] += pairDistances[i] * 0.1f * (fabsf(ratios[i] - 0.5f) + 0.5f);
+    }
+}
+
+//The tri-tone penalty for a batch of mixes that share their first two
+//colors, pairDistance apart, with thirds[i] as mix i's third color.
+void triTonePenaltyBatch(TrueColor target, TrueColor triTone, const ColorBatch &mixes, const ColorBatch &thirds, float pairDistance, float *out){
+    alignas(32) float toneDistances[ColorBatch::capacity];
+    distanceBatch(target, mixes, out);
+    distanceBatch(triTone, thirds, toneDistances);
+    for(uint32_t i = 0; i < mixes.count; i++){
+        out[i] += pairDistance * 0.025f + toneDistances[i] * 0.025f;
+    }
+}
+
+//Caches plans for a grid of 2^bits steps per channel, so pixels that
+//land in the same cell share one plan and a smooth gradient only costs
+//a plan search per cell instead of per pixel. Cells get filled the
+//first time a pixel asks for them. Whoever wins the compare and swap
+//on a cell gets to store its plan; everyone else just uses the plan
+//they worked out themselves, so no thread ever waits on another.
+//The table can be saved next to the palette and loaded back next time.
+struct PaletteLUT{
+    enum CellState : uint8_t {Empty, Filling, Ready};
+
+    uint32_t bits;
+    std::vector<MixPlan> plans;
+    std::unique_ptr<std::atomic<uint8_t>[]> state;
+
+    PaletteLUT(uint32_t b) : bits(std::min<uint32_t>(std::max<uint32_t>(b, 1), 8)){
+        plans.resize(cellCount());
+        state.reset(new std::atomic<uint8_t>[cellCount()]);
+        for(uint32_t i = 0; i < cellCount(); i++) state[i].store(Empty);
+    }
+
+    uint32_t cellCount() const{
+        return 1u << (bits * 3);
+    }
+
+    uint32_t cellIndex(TrueColor color) const{
+        uint32_t shift = 8 - bits;
+        return ((uint32_t)(color.R >> shift) << (bits * 2)) | ((uint32_t)(color.G >> shift) << bits) | (uint32_t)(color.B >> shift);
+    }
+
+    //The color in the middle of a cell, which its plan gets worked out for.
+    TrueColor cellColor(uint32_t index) const{
+        uint32_t shift = 8 - bits, mask = (1u << bits) - 1, half = (1u << shift) >> 1;
+        return TrueColor((((index >> (bits * 2)) & mask) << shift) + half,
+                         (((index >> bits) & mask) << shift) + half,
+                         ((index & mask) << shift) + half);
+    }
+
+    template<typename Devise>
+    MixPlan lookup(TrueColor color, Devise devise){
+        uint32_t index = cellIndex(color);
+        if(state[index].load(std::memory_order_acquire) == Ready)
+            return plans[index];
+
+        MixPlan plan = devise(cellColor(index));
+        uint8_t expected = Empty;
+        if(state[index].compare_exchange_strong(expected, Filling, std::memory_order_acquire)){
+            plans[index] = plan;
+            state[index].store(Ready, std::memory_order_release);
+        }
+        return plan;
+    }
+
+    uint32_t filledCells() const{
+        uint32_t filled = 0;
+        for(uint32_t i = 0; i < cellCount(); i++) filled += state[i].load() == Ready;
+        return filled;
+    }
+
+    //The file starts with the grid size and the palette and candidate
+    //count it was made for, so a table never gets used with plans that
+    //would have come out differently.
+    bool save(std::string filename, const std::vector<TrueColor> &colors, uint32_t candidates) const{
+        std::ofstream output(filename, std::ios::binary);
+        if(!output)
+            return false;
+
+        uint32_t header[4] = {lutMagic, bits, (uint32_t)colors.size(), candidates};
+        output.write((const char*)header, sizeof(header));
+        output.write((const char*)colors.data(), colors.size() * sizeof(TrueColor));
+        for(uint32_t i = 0; i < cellCount(); i++){
+            uint8_t ready = state[i].load() == Ready;
+            output.write((const char*)&ready, 1);
+        }
+        output.write((const char*)plans.data(), plans.size() * sizeof(MixPlan));
+        return (bool)output;
+    }
+
+    bool load(std::string filename, const std::vector<TrueColor> &colors, uint32_t candidates){
+        std::ifstream input(filename, std::ios::binary);
+        uint32_t header[4];
+        if(!input.read((char*)header, sizeof(header)) || header[0] != lutMagic || header[1] != bits || header[2] != colors.size() || header[3] != candidates)
+            return false;
+
+        std::vector<TrueColor> fileColors(colors.size());
+        input.read((char*)fileColors.data(), fileColors.size() * sizeof(TrueColor));
+        if(!input || !std::equal(colors.begin(), colors.end(), fileColors.begin(), [](TrueColor a, TrueColor b){ return !(a != b); }))
+            return false;
+
+        std::vector<uint8_t> ready(cellCount());
+        std::vector<MixPlan> filePlans(cellCount());
+        input.read((char*)ready.data(), ready.size());
+        input.read((char*)filePlans.data(), filePlans.size() * sizeof(MixPlan));
+        if(!input)
+            return false;
+
+        plans = filePlans;
+        for(uint32_t i = 0; i < cellCount(); i++) state[i].store(ready[i] ? Ready : Empty);
+        return true;
+    }
+
+    static constexpr uint32_t lutMagic = 0x3254554C; //"LUT2"
+};
+
+//distCompare is a quadratic form: for a difference d between two colors
+//it works out to d^T M d, with M = 0.75 * diag(w) + w w^T and w the luma
+//weights. Splitting M into L L^T with a Cholesky factorization and moving
+//every color to L^T c turns it into a plain squared Euclidean distance,
+//which is what a k-d tree needs to prune exactly.
+struct WeightedColor{
+    double v[3];
+
+    WeightedColor(TrueColor color){
+        static const double *L = choleskyFactor();
+        double r = color.R / 255.0, g = color.G / 255.0, b = color.B / 255.0;
+        v[0] = L[0] * r + L[3] * g + L[6] * b;
+        v[1] = L[4] * g + L[7] * b;
+        v[2] = L[8] * b;
+    }
+    WeightedColor() = default;
+
+    double distance(const WeightedColor &other) const{
+        double d0 = v[0] - other.v[0], d1 = v[1] - other.v[1], d2 = v[2] - other.v[2];
+        return d0 * d0 + d1 * d1 + d2 * d2;
+    }
+
+    //Lower triangular L, row major.
+    static const double *choleskyFactor(){
+        static double L[9] = {};
+        const double w[3] = {0.299, 0.587, 0.114};
+        double M[9];
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j < 3; j++) M[i * 3 + j] = w[i] * w[j] + (i == j ? 0.75 * w[i] : 0.0);
+        }
+        for(int i = 0; i < 3; i++){
+            for(int j = 0; j <= i; j++){
+                double sum = M[i * 3 + j];
+                for(int k = 0; k < j; k++) sum -= L[i * 3 + k] * L[j * 3 + k];
+                L[i * 3 + j] = i == j ? sqrt(sum) : sum / L[j * 3 + j];
+            }
+        }
+        return L;
+    }
+};
+
+//A k-d tree over the palette in the weighted space above. It's stored
+//flat: a range's node sits in its middle, with the halves on either
+//side, split along whichever axis spreads the most.
+struct PaletteTree{
+    struct Node{
+        WeightedColor point;
+        uint8_t index, axis;
+    };
+    std::vector<Node> nodes;
+
+    void build(const std::vector<TrueColor> &colors){
+        nodes.resize(colors.size());
+        for(uint32_t i = 0; i < colors.size(); i++){
+            nodes[i].point = WeightedColor(colors[i]);
+            nodes[i].index = i;
+        }
+        buildRange(0, nodes.size());
+    }
+
+    void buildRange(uint32_t first, uint32_t last){
+        if(last - first < 2){
+            if(first < last) nodes[first].axis = 0;
+            return;
+        }
+
+        uint8_t axis = 0;
+        double widest = -1.0;
+        for(uint8_t a = 0; a < 3; a++){
+            auto range = std::minmax_element(nodes.begin() + first, nodes.begin() + last, [a](const Node &x, const Node &y){ return x.point.v[a] < y.point.v[a]; });
+            double spread = range.second->point.v[a] - range.first->point.v[a];
+            if(spread > widest){
+                widest = spread;
+                axis = a;
+            }
+        }
+
+        uint32_t middle = (first + last) / 2;
+        std::nth_element(nodes.begin() + first, nodes.begin() + middle, nodes.begin() + last, [axis](const Node &x, const Node &y){ return x.point.v[axis] < y.point.v[axis]; });
+        nodes[middle].axis = axis;
+        buildRange(first, middle);
+        buildRange(middle + 1, last);
+    }
+
+    //The k closest palette entries to color, closest first. Returns how
+    //many there were, which is less than k for small palettes.
+    uint32_t nearest(TrueColor color, uint32_t k, uint8_t *indices) const{
+        k = std::min<uint32_t>(k, nodes.size());
+        if(k == 0)
+            return 0;
+
+        double distances[256];
+        uint32_t found = 0;
+        search(0, nodes.size(), WeightedColor(color), k, indices, distances, found);
+        return found;
+    }
+
+    //The single closest palette entry. Ties go to the lower index, same
+    //as scanning the palette front to back would.
+    uint8_t nearest(TrueColor color) const{
+        uint8_t best = 0;
+        double bestDistance = std::numeric_limits<double>::max();
+        searchNearest(0, nodes.size(), WeightedColor(color), best, bestDistance);
+        return best;
+    }
+
+    void searchNearest(uint32_t first, uint32_t last, const WeightedColor &target, uint8_t &best, double &bestDistance) const{
+        if(first >= last)
+            return;
+
+        uint32_t middle = (first + last) / 2;
+        const Node &node = nodes[middle];
+        double dist = node.point.distance(target);
+        if(dist < bestDistance || (dist == bestDistance && node.index < best)){
+            bestDistance = dist;
+            best = node.index;
+        }
+
+        double split = target.v[node.axis] - node.point.v[node.axis];
+        uint32_t nearFirst = split < 0.0 ? first : middle + 1, nearLast = split < 0.0 ? middle : last;
+        uint32_t farFirst = split < 0.0 ? middle + 1 : first, farLast = split < 0.0 ? last : middle;
+        searchNearest(nearFirst, nearLast, target, best, bestDistance);
+        if(split * split <= bestDistance)
+            searchNearest(farFirst, farLast, target, best, bestDistance);
+    }
+
+    void search(uint32_t first, uint32_t last, const WeightedColor &target, uint32_t k, uint8_t *indices, double *distances, uint32_t &found) const{
+        if(first >= last)
+            return;
+
+        uint32_t middle = (first + last) / 2;
+        const Node &node = nodes[middle];
+
+        //Keep the best k sorted by inserting from the back.
+        double dist = node.point.distance(target);
+        if(found < k || dist < distances[found - 1]){
+            uint32_t slot = found < k ? found++ : k - 1;
+            while(slot > 0 && distances[slot - 1] > dist){
+                distances[slot] = distances[slot - 1];
+                indices[slot] = indices[slot - 1];
+                slot--;
+            }
+            distances[slot] = dist;
+            indices[slot] = node.index;
+        }
+
+        double split = target.v[node.axis] - node.point.v[node.axis];
+        if(split < 0.0){
+            search(first, middle, target, k, indices, distances, found);
+            if(found < k || split * split < distances[found - 1])
+                search(middle + 1, last, target, k, indices, distances, found);
+        }
+        else{
+            search(middle + 1, last, target, k, indices, distances, found);
+            if(found < k || split * split < distances[found - 1])
+                search(first, middle, target, k, indices, distances, found);
+        }
+    }
+};
+
+#define d(x) x/64.0
+constexpr double matrix[8][8] = {
+d( 0), d(48), d(12), d(60), d( 3), d(51), d(15), d(63),
+d(32), d(16), d(44), d(28), d(35), d(19), d(47), d(31),
+d( 8), d(56), d( 4), d(52), d(11), d(59), d( 7), d(55),
+d(40), d(24), d(36), d(20), d(43), d(27), d(39), d(23),
+d( 2), d(50), d(14), d(62), d( 1), d(49), d(13), d(61),
+d(34), d(18), d(46), d(30), d(33), d(17), d(45), d(29),
+d(10), d(58), d( 6), d(54), d( 9), d(57), d( 5), d(53),
+d(42), d(26), d(38), d(22), d(41), d(25), d(37), d(21) };
+#undef d
+
+//Dithered renders mix a plan's colors through the ordered dither
+//matrix. Nearest ones just snap every pixel to its closest color.
+enum PaletteMode{Dithered, Nearest};
+
+//Plans only ever mix the candidateCount palette colors closest to the
+//target, found through the tree, so big palettes cost about the same
+//per plan as a 16 color one.
 struct Palette{
     std::vector<TrueColor> pal;
+    std::shared_ptr<PaletteLUT> lut;
+    PaletteTree tree;
+    uint32_t candidateCount = 16;
+    PaletteMode mode = Dithered;
     
     Palette() = default;
     Palette(std::string filename){
         loadPalFile(filename);
     }
 
-    uint32_t getNumColors(){
+    uint32_t getNumColors() const{
         return pal.size();
     }
 
@@ -66,6 +442,12 @@ struct Palette{
         while (input >> r >> g >> b){
             pal.push_back(TrueColor(r, g, b));
         }
+        //Plans keep colors as byte sized indices.
+        if(pal.size() > 256){
+            std::cout << filename << " has more than 256 colors, only the first 256 get used." << std::endl;
+            pal.resize(256);
+        }
+        tree.build(pal);
     }
 
     void loadBinFile(std::string filename){
@@ -74,31 +456,67 @@ struct Palette{
         while (input >> r >> g >> b){
             pal.push_back(TrueColor(r * 4, g * 4, b * 4));
         }
+        pal.resize(std::min<size_t>(pal.size(), 256));
+        tree.build(pal);
     }
 
-    TrueColor nearestFromPalette(TrueColor original){
-        double nearestDistance = std::numeric_limits<double>::max();
-        TrueColor nearestColor;
-        for(uint32_t x = 0; x < getNumColors(); x++){
-            TrueColor palColor = pal[x];
-            double dist = original.distCompare(palColor);
-            if(dist < nearestDistance){
-                nearestDistance = dist;
-                nearestColor = palColor;
-            }
-        }
-        return nearestColor;
+    TrueColor nearestFromPalette(TrueColor original) const{
+        return pal[tree.nearest(original)];
+    }
+
+    //Zero bits turns the table off, and every pixel gets its own plan.
+    void useLUT(uint32_t bits){
+        lut = bits > 0 ? std::make_shared<PaletteLUT>(bits) : nullptr;
+    }
+
+    MixPlan planFor(TrueColor original) const{
+        if(!lut)
+            return deviseColorPlan(original);
+        return lut->lookup(original, [this](TrueColor color){ return deviseColorPlan(color); });
+    }
+
+    //The palette index a pixel at (x, y) ends up as. Only the pixel's own
+    //color and position go into it, so any part of the image can be done
+    //on its own, in any order.
+    uint8_t quantize(TrueColor color, int x, int y) const{
+        if(mode == Nearest)
+            return tree.nearest(color);
+
+        MixPlan paletteMix = planFor(color);
+        if(paletteMix.mixRatio == 4.0f)
+            return paletteMix.colors[((y & 1) * 2 + (x & 1))];
+        double factor = matrix[x % 8][y % 8];
+        return paletteMix.colors[factor < paletteMix.mixRatio ? 1 : 0];
     }
 
-    MixPlan deviseColorPlan(TrueColor original){
-        MixPlan result = {{TrueColor(), TrueColor()}, 0};
-        double nearestPenalty = std::numeric_limits<double>::max();
+    //Penalties get worked out in float through the batch kernels: all
+    //the two color mixes with one first color at a time, then all the
+    //tri-tones on top of each pair.
+    MixPlan deviseColorPlan(TrueColor original) const{
+        MixPlan result = {{0, 0, 0, 0}, 0.0f};
+        float nearestPenalty = std::numeric_limits<float>::max();
+
+        //Going through the candidates in palette order means a palette no
+        //bigger than candidateCount gets searched just like it always was.
+        uint8_t candidates[256];
+        uint32_t count = tree.nearest(original, candidateCount, candidates);
+        std::sort(candidates, candidates + count);
+
+        ColorBatch colors, mixes;
+        for(uint32_t c = 0; c < count; c++) colors.set(c, pal[candidates[c]]);
+        colors.count = count;
+
+        alignas(32) float pairDistances[ColorBatch::capacity], ratios[ColorBatch::capacity];
+        alignas(32) float penalties[ColorBatch::capacity], triPenalties[ColorBatch::capacity];
 
-        for(u8 index1 = 0; index1 < 16; index1++){
-            for(u8 index2 = index1; index2 < 16; index2++){
-                TrueColor color1 = pal[index1];
-                TrueColor color2 = pal[index2];
-                int ratio;
+        for(uint32_t c1 = 0; c1 < count; c1++){
+            TrueColor color1 = pal[candidates[c1]];
+            distanceBatch(color1, colors, pairDistances);
+
+            mixes.count = count - c1;
+            for(uint32_t c2 = c1; c2 < count; c2++){
+                TrueColor color2 = pal[candidates[c2]];
+                int ratio = 32;
 
                 if(color1 != color2){
                     ratio = ((color2.R != color1.R ? 299*64 * int(original.R - color1.R) / int(color2.R - color1.R) : 0)
@@ -113,38 +531,43 @@ struct Palette{
                 u8 r0 = color1.R + ratio * (int)(color2.R - color1.R) / 64;
                 u8 g0 = color1.G + ratio * (int)(color2.G - color1.G) / 64;
                 u8 b0 = color1.B + ratio * (int)(color2.B - color1.B) / 64;
-                TrueColor rgb0(r0, g0, b0);
-
-                double penalty = original.mixingPenalty(rgb0, color1, color2, ratio / 64.0);
+                mixes.set(c2 - c1, TrueColor(r0, g0, b0));
+                ratios[c2 - c1] = ratio / 64.0f;
+            }
+            mixingPenaltyBatch(original, mixes, pairDistances + c1, ratios, penalties);
 
-                if(penalty < nearestPenalty){
-                    nearestPenalty = penalty;
-                    result.colors[0] = pal[index1];
-                    result.colors[1] = pal[index2];
-                    result.mixRatio = ratio / 64.0;
+            for(uint32_t c2 = c1; c2 < count; c2++){
+                if(penalties[c2 - c1] < nearestPenalty){
+                    nearestPenalty = penalties[c2 - c1];
+                    result.colors[0] = candidates[c1];
+                    result.colors[1] = candidates[c2];
+                    result.mixRatio = ratios[c2 - c1];
                 }
                 
-                if(index1 != index2){
-                    for(u8 index3 = 0; index3 < 16; index3++){
-                        if(index3 == index2 || index3 == index1)
-                            continue;
-
-                        TrueColor color3 = pal[index3];
-
-                        rgb0 = TrueColor((color1.R + color2.R + color3.R * 2) / 4, 
-                                         (color1.G + color2.G + color3.G * 2) / 4,
-                                         (color1.B + color2.B + color3.B * 2) / 4);
-                        TrueColor triTone((color1.R + color1.G) / 2,(color1.G + color2.G) / 2, (color1.B + color2.B) / 2); 
-                        penalty = original.distCompare(rgb0) + color1.distCompare(color2) * 0.025 +
-                                  triTone.distCompare(color3) * 0.025;
-                        if(penalty < nearestPenalty){
-                            nearestPenalty = penalty;
-                            result.colors[0] = pal[index3]; 
-                            result.colors[1] = pal[index1]; 
-                            result.colors[2] = pal[index2]; 
-                            result.colors[3] = pal[index3];
-                            result.mixRatio = 4.0;
-                        }
+                if(c1 == c2)
+                    continue;
+
+                TrueColor color2 = pal[candidates[c2]];
+                mixes.count = count;
+                for(uint32_t c3 = 0; c3 < count; c3++){
+                    TrueColor color3 = pal[candidates[c3]];
+                    mixes.set(c3, TrueColor((color1.R + color2.R + color3.R * 2) / 4, 
+                                            (color1.G + color2.G + color3.G * 2) / 4,
+                                            (color1.B + color2.B + color3.B * 2) / 4));
+                }
+                TrueColor triTone((color1.R + color2.R) / 2,(color1.G + color2.G) / 2, (color1.B + color2.B) / 2); 
+                triTonePenaltyBatch(original, triTone, mixes, colors, pairDistances[c2], triPenalties);
+
+                for(uint32_t c3 = 0; c3 < count; c3++){
+                    if(c3 == c1 || c3 == c2)
+                        continue;
+                    if(triPenalties[c3] < nearestPenalty){
+                        nearestPenalty = triPenalties[c3];
+                        result.colors[0] = candidates[c3]; 
+                        result.colors[1] = candidates[c1]; 
+                        result.colors[2] = candidates[c2]; 
+                        result.colors[3] = candidates[c3];
+                        result.mixRatio = 4.0f;
                     }
                 }
             }
@@ -154,38 +577,13 @@ struct Palette{
 
 };
 
-#define d(x) x/64.0
-constexpr double matrix[8][8] = {
-d( 0), d(48), d(12), d(60), d( 3), d(51), d(15), d(63),
-d(32), d(16), d(44), d(28), d(35), d(19), d(47), d(31),
-d( 8), d(56), d( 4), d(52), d(11), d(59), d( 7), d(55),
-d(40), d(24), d(36), d(20), d(43), d(27), d(39), d(23),
-d( 2), d(50), d(14), d(62), d( 1), d(49), d(13), d(61),
-d(34), d(18), d(46), d(30), d(33), d(17), d(45), d(29),
-d(10), d(58), d( 6), d(54), d( 9), d(57), d( 5), d(53),
-d(42), d(26), d(38), d(22), d(41), d(25), d(37), d(21) };
-#undef d
-
-void writeRenderPalettized(Palette pal, u8* data, u16 imgWidth, u16 imgHeight, u8 imgDepth){
-    TrueColor *result = new TrueColor[imgWidth * imgHeight];
 
-    #pragma omp parallel for
-    for(int x = 0; x < imgWidth; x++){
-        for(int y = 0; y < imgHeight; y++){
-            uint8_t red = data[(x + imgWidth * y) * imgDepth];
-            uint8_t green = data[(x + imgWidth * y) * imgDepth + 1];
-            uint8_t blue = data[(x + imgWidth * y) * imgDepth + 2];
-
-            MixPlan paletteMix = pal.deviseColorPlan(TrueColor(red, green, blue));
-            if(paletteMix.mixRatio = 4.0){
-                result[(x + y * imgWidth)] = paletteMix.colors[((y & 1) * 2 + (x & 1))];
-            }else{
-                double factor = matrix[x % 8][y % 8];
-                result[(x + y * imgWidth)] = paletteMix.colors[factor < paletteMix.mixRatio ? 1 : 0];
-            } 
+//Quantizes the pixels in [x0, x1) x [y0, y1) of an image into indices.
+void palettizeRegion(const Palette &pal, const u8* data, u8* indices, u16 imgWidth, u8 imgDepth, int x0, int y0, int x1, int y1){
+    for(int y = y0; y < y1; y++){
+        for(int x = x0; x < x1; x++){
+            const u8* pixel = &data[(x + imgWidth * y) * imgDepth];
+            indices[x + imgWidth * y] = pal.quantize(TrueColor(pixel[0], pixel[1], pixel[2]), x, y);
         }
     }
-
-    stbi_write_png("result.png", imgWidth, imgHeight, imgDepth, result, 0);
-    delete result;
-}
\ No newline at end of file
+}
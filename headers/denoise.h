@@ -0,0 +1,132 @@
+//Edge-avoiding a-trous wavelet filter, after Dammertz et al. Each pass
+//blurs with a 5x5 B3 spline kernel whose taps are spread twice as far
+//apart as in the pass before, so five passes cover a 125 pixel wide
+//footprint for 25 taps a pixel each. Taps only count as much as their
+//normal, depth, albedo and color look like the center pixel's, which
+//keeps the blur from crossing edges. The albedo gets divided out first
+//and multiplied back in at the end, so textures don't get blurred with
+//the lighting noise.
+
+//First hits of every camera sample, summed so edges come out
+//antialiased like the render itself.
+struct GuideBuffers{
+	std::vector<glm::vec3> normal, albedo;
+	std::vector<float> depth;
+	std::vector<u32> samples;
+
+	GuideBuffers(u32 pixels) : normal(pixels, glm::vec3(0.0f)), albedo(pixels, glm::vec3(0.0f)), depth(pixels, 0.0f), samples(pixels, 0) {}
+
+	void add(u32 index, const SurfaceGuide &guide){
+		normal[index] += guide.normal;
+		albedo[index] += guide.albedo;
+		depth[index] += guide.depth;
+		samples[index]++;
+	}
+
+	SurfaceGuide average(u32 index) const{
+		float scale = samples[index] ? 1.0f / samples[index] : 0.0f;
+		return {normal[index] * scale, albedo[index] * scale, depth[index] * scale};
+	}
+};
+
+//How different a tap can be before it stops counting. Colors are linear
+//and divided by albedo, and the color sigma halves every pass since the
+//noise it has to see past keeps dropping. Depth differences are relative.
+struct DenoiseSettings{
+	bool enabled = false;
+	u32 iterations = 5;
+	//Pass 10 already takes taps 512 pixels apart, and every pass after it
+	//would only reach past the edges of the image.
+	static constexpr long maxIterations = 10;
+	float colorSigma = 0.5f, normalSigma = 0.3f, depthSigma = 0.05f, albedoSigma = 0.1f;
+};
+
+struct Denoiser{
+	const DenoiseSettings &settings;
+	u16 width, height, tileSize;
+	std::vector<SurfaceGuide> guides;
+	std::vector<glm::vec3> current, next;
+
+	//The albedo gets a little extra so black texels don't divide by zero.
+	static constexpr float albedoFloor = 1e-3f;
+
+	Denoiser(const DenoiseSettings &s, const FrameBuffer &frame, const GuideBuffers &guideSums, u16 tiles) : settings(s),
+	width(frame.width), height(frame.height), tileSize(tiles), guides((size_t)width * height), current((size_t)width * height), next((size_t)width * height){
+		#pragma omp parallel for
+		for(int i = 0; i < width * height; i++){
+			guides[i] = guideSums.average(i);
+			current[i] = frame.load(i) / (guides[i].albedo + glm::vec3(albedoFloor));
+		}
+	}
+
+	void filterTile(const Tile &tile, int step, float colorWeight){
+		static const float kernel[5] = {1.0f / 16.0f, 1.0f / 4.0f, 3.0f / 8.0f, 1.0f / 4.0f, 1.0f / 16.0f};
+		float normalWeight = 1.0f / (settings.normalSigma * settings.normalSigma);
+		float albedoWeight = 1.0f / (settings.albedoSigma * settings.albedoSigma);
+
+		for(int y = tile.y0; y < tile.y1; y++){
+			for(int x = tile.x0; x < tile.x1; x++){
+				u32 center = x + y * width;
+				const SurfaceGuide &guide = guides[center];
+				glm::vec3 color = current[center];
+				float depthWeight = 1.0f / std::max(settings.depthSigma * guide.depth, 1e-6f);
+				depthWeight *= depthWeight;
+
+				glm::vec3 sum(0.0f);
+				float weights = 0.0f;
+				for(int dy = -2; dy <= 2; dy++){
+					int ty = y + dy * step;
+					if(ty < 0 || ty >= height)
+						continue;
+					for(int dx = -2; dx <= 2; dx++){
+						int tx = x + dx * step;
+						if(tx < 0 || tx >= width)
+							continue;
+
+						u32 tap = tx + ty * width;
+						const SurfaceGuide &other = guides[tap];
+						glm::vec3 colorDelta = current[tap] - color, normalDelta = other.normal - guide.normal, albedoDelta = other.albedo - guide.albedo;
+						float depthDelta = other.depth - guide.depth;
+						float distance = glm::dot(colorDelta, colorDelta) * colorWeight + glm::dot(normalDelta, normalDelta) * normalWeight +
+										 glm::dot(albedoDelta, albedoDelta) * albedoWeight + depthDelta * depthDelta * depthWeight;
+
+						float weight = kernel[dx + 2] * kernel[dy + 2] * expf(-distance);
+						sum += current[tap] * weight;
+						weights += weight;
+					}
+				}
+				//The center tap always has a weight of its own, so this never divides by zero.
+				next[center] = sum / weights;
+			}
+		}
+	}
+
+	//Filters the frame in place, one pass at a time with the tiles of
+	//each pass spread over the threads. Every tile costs about the same,
+	//so a plain dynamic schedule is all the balancing this needs.
+	void run(FrameBuffer &frame){
+		std::vector<Tile> tiles = tileGrid(width, height, tileSize);
+		for(u32 pass = 0; pass < settings.iterations; pass++){
+			float sigma = settings.colorSigma / (1 << pass);
+			float colorWeight = 1.0f / (sigma * sigma);
+
+			#pragma omp parallel for schedule(dynamic)
+			for(int t = 0; t < (int)tiles.size(); t++){
+				filterTile(tiles[t], 1 << pass, colorWeight);
+			}
+			std::swap(current, next);
+		}
+
+		#pragma omp parallel for
+		for(int i = 0; i < width * height; i++){
+			frame.store(i, current[i] * (guides[i].albedo + glm::vec3(albedoFloor)));
+		}
+	}
+};
+
+void denoiseFrame(FrameBuffer &frame, const GuideBuffers &guides, const DenoiseSettings &settings, u16 tileSize){
+	PhaseTimer denoiseTimer;
+	Denoiser denoiser(settings, frame, guides, tileSize);
+	denoiser.run(frame);
+	renderStats.denoiseTime += denoiseTimer.elapsed();
+}
@@ -3,78 +3,475 @@
 
 #include "stb_image_write.h"
 
+#include <csignal>
+#include <cctype>
 #include "tracing.h"
+#include "tiles.h"
 #include "colorManagement.h"
+#include "indexedImage.h"
+#include "animation.h"
+#include "accumulation.h"
+#include "framebuffer.h"
+#include "denoise.h"
 
 struct Camera{
 	glm::vec3 position, rotationAxis;
 	float rotation, renderFov;
-	glm::vec3 background;
+};
+
+//Renders one sample per pixel per pass and writes the image out every
+//so often along the way. No passes means it keeps going until stopped.
+struct ProgressiveSettings{
+	bool enabled = false;
+	u32 passes = 0;
+	float snapshotSeconds = 0.0f;
+	u32 snapshotPasses = 0;
+};
+
+//Spends samples where the pixels are still noisy. Every pixel gets
+//minSamples, then rounds of one more sample go to the pixels whose
+//standard error is above the threshold, until they settle down or the
+//budget of average samples per pixel runs out.
+struct AdaptiveSettings{
+	bool enabled = false;
+	u32 minSamples = 2, maxSamples = 64;
+	float budget = 4.0f;
+	float threshold = 0.005f;
 };
 
 struct Options{
 	std::string renderName, encodeType;
 	u16 renderWidth, renderHeight;
 	u8 renderChannels, renderSamples;
+	u16 tileSize = 32;
+	uint64_t seed = 0;
 	Camera camMan;
+	TraceSettings trace;
+	PixelSampler pixelSampler;
+	Resolver resolver;
+	//Keep the frame in half floats instead of floats.
+	bool halfFloat = false;
 	bool palette = false;
+	//Palettize each tile as soon as it's traced, while it's still in
+	//cache, instead of in a second pass over the finished render.
+	bool palettizeTiles = false;
 	Palette pal;
+	ProgressiveSettings progressive;
+	AdaptiveSettings adaptive;
+	DenoiseSettings denoise;
 	Options(std::string renderN, std::string encodeT,u16 renderW, u16 renderH, u8 renderC, u8 renderS): renderName(renderN), encodeType(encodeT),renderWidth(renderW), 
 	renderHeight(renderH), renderChannels(renderC), renderSamples(renderS){}
 };
 
-u8 convertVec(float d){
-	return fmax(0.0f, fmin(255.0f, d * 255.0f));
-}
-
+//x and y are positions on the image, so pixel centers are at + 0.5.
 glm::vec3 calculateWin(float fov, float x, float y, u16 w, u16 h){
-	float i =  (2*(x + 0.5f)/(float)w  - 1)*tan(fov/2.0f)*w/(float)h;
-    float j = -(2*(y + 0.5f)/(float)h - 1)*tan(fov/2.0f);
+	float i =  (2*x/(float)w  - 1)*tan(fov/2.0f)*w/(float)h;
+    float j = -(2*y/(float)h - 1)*tan(fov/2.0f);
 	return glm::vec3(i, j, -1);
 }
 
-void PNGEncode(std::vector<Object*> objects, std::vector<Light*> lights, Options opts){
-	u8* render = new u8[opts.renderWidth * opts.renderHeight * opts.renderChannels];
-	glm::mat3 rotMat = glm::rotate(glm::radians(opts.camMan.rotation), opts.camMan.rotationAxis);
+//Not a bounce, just a stream of its own for the camera.
+const u32 cameraStream = 0xFFFFFFFF;
+
+//Each pixel shifts the sample pattern by its own random amount, and
+//picks a new shift every time the pattern runs out.
+glm::vec3 tracePixelSample(const Scene &scene, const Options &opts, const glm::mat3 &rotMat, int x, int y, u32 sample, SurfaceGuide *guide = nullptr){
+	u32 pixel = x + y * opts.renderWidth;
+	const PixelSampler &sampler = opts.pixelSampler;
+	RandomStream rng(opts.seed, pixel, sample / sampler.count(), cameraStream);
+	glm::vec2 offset = sampler.offset(sample, glm::vec2(rng.nextFloat(), rng.nextFloat()));
 	
-	auto timeThen = std::chrono::system_clock::now(), timeNow = std::chrono::system_clock::now();
-	float elapsedTime = 0.0f;
+	glm::vec3 dir = rotMat * glm::normalize(calculateWin(opts.camMan.renderFov, x + offset.x, y + offset.y, opts.renderWidth, opts.renderHeight));
+	Ray currentRay(opts.camMan.position, dir);
+	threadCounters.primaryRays++;
+
+	PixelSample pixelSample = {opts.seed, pixel, sample};
+	return cast_ray(currentRay, scene, opts.trace, pixelSample, guide);
+}
+
+//Traces one sample into the guides as well, if there are any.
+glm::vec3 guidedSample(const Scene &scene, const Options &opts, const glm::mat3 &rotMat, int x, int y, u32 sample, GuideBuffers *guides){
+	if(!guides)
+		return tracePixelSample(scene, opts, rotMat, x, y, sample);
+	SurfaceGuide guide;
+	glm::vec3 color = tracePixelSample(scene, opts, rotMat, x, y, sample, &guide);
+	guides->add(x + y * opts.renderWidth, guide);
+	return color;
+}
+
+glm::vec3 renderPixel(const Scene &scene, const Options &opts, const glm::mat3 &rotMat, int x, int y, GuideBuffers *guides){
+	glm::vec3 finalResult;
+	for(int sample = 0; sample < opts.renderSamples; sample++){
+		finalResult += guidedSample(scene, opts, rotMat, x, y, sample, guides);
+	}
+	return finalResult / (float)opts.renderSamples;
+}
+
+//Hands every tile to tileWork across the OpenMP team, keeping track of
+//how busy each thread was and how long the whole thing took.
+template<typename TileWork>
+void forEachTile(TileScheduler &scheduler, TileWork tileWork){
+	PhaseTimer renderTimer;
 	
-	#pragma omp parallel for
-	for(int x = 0; x < opts.renderWidth; x++){
-		for(int y = 0; y < opts.renderHeight; y++){
-			timeNow = std::chrono::system_clock::now();
-			std::chrono::duration<float> deltaChrono = timeNow - timeThen;
-			timeThen = timeNow;
-			
-			glm::vec3 finalResult;
-			for(int sample = 0; sample < opts.renderSamples; sample++){
-				float sampleX = (x + 0.5f + ((sample < 2) ? -0.25f : 0.25f)); 
-				float sampleY = (y + 0.5f + ((sample >= 2) ? -0.25f : 0.25f));
-				
-				glm::vec3 dir = rotMat * glm::normalize(calculateWin(opts.camMan.renderFov, sampleX, sampleY, opts.renderWidth, opts.renderHeight));
-				Ray currentRay(opts.camMan.position, dir);
-				
-				finalResult += cast_ray(currentRay, objects, lights, opts.camMan.background);
+	#pragma omp parallel
+	{
+		int thread = renderThreadIndex();
+		Tile tile;
+		while(scheduler.next(thread, tile)){
+			auto tileStart = std::chrono::steady_clock::now();
+			tileWork(tile);
+			std::chrono::duration<float> tileTime = std::chrono::steady_clock::now() - tileStart;
+			scheduler.times[thread].busy += tileTime.count();
+		}
+		renderStats.gatherThread();
+	}
+
+	renderStats.renderTime += renderTimer.elapsed();
+}
+
+void resolveFrame(const FrameBuffer &frame, const Options &opts, u8* render){
+	PhaseTimer resolveTimer;
+	opts.resolver.resolveImage(frame, render, opts.renderChannels);
+	renderStats.resolveTime += resolveTimer.elapsed();
+}
+
+void finishFrame(FrameBuffer &frame, const GuideBuffers *guides, const Options &opts, u8* render){
+	if(guides)
+		denoiseFrame(frame, *guides, opts.denoise, opts.tileSize);
+	resolveFrame(frame, opts, render);
+}
+
+//Traces one frame into the frame buffer and resolves it into render,
+//denoising it first if there are guides. Given indices, each tile also
+//gets resolved and palettized as soon as it's done, while it's still
+//in cache, which can't be combined with denoising.
+void renderFrame(const Scene &scene, const Options &opts, TileScheduler &scheduler, FrameBuffer &frame, GuideBuffers *guides, u8* render, u8* indices){
+	glm::mat3 rotMat = glm::rotate(glm::radians(opts.camMan.rotation), opts.camMan.rotationAxis);
+	
+	forEachTile(scheduler, [&](const Tile &tile){
+		for(int y = tile.y0; y < tile.y1; y++){
+			for(int x = tile.x0; x < tile.x1; x++){
+				frame.store(x + y * opts.renderWidth, renderPixel(scene, opts, rotMat, x, y, guides));
 			}
-			finalResult /= opts.renderSamples;
-			
-			render[opts.renderChannels *(x + y * opts.renderWidth)] = convertVec(finalResult.x);
-			render[opts.renderChannels *(x + y * opts.renderWidth)+ 1] = convertVec(finalResult.y);
-			render[opts.renderChannels *(x + y * opts.renderWidth) + 2] = convertVec(finalResult.z);
-			
-			elapsedTime += deltaChrono.count();
 		}
+		if(indices){
+			PhaseTimer palettizeTimer;
+			opts.resolver.resolveRegion(frame, render, opts.renderChannels, tile.x0, tile.y0, tile.x1, tile.y1);
+			palettizeRegion(opts.pal, render, indices, opts.renderWidth, opts.renderChannels, tile.x0, tile.y0, tile.x1, tile.y1);
+			//With tiles this is time spent palettizing summed over threads,
+			//and it's already part of the render time.
+			float palettizeTime = palettizeTimer.elapsed();
+			#pragma omp atomic
+			renderStats.palettizeTime += palettizeTime;
+		}
+	});
+
+	if(!indices)
+		finishFrame(frame, guides, opts, render);
+}
+
+void reportThreads(const TileScheduler &scheduler){
+	for(auto &time : scheduler.times){
+		renderStats.threads.push_back({time.busy, std::max(0.0f, renderStats.renderTime - time.busy)});
 	}
+	scheduler.printStats(renderStats.renderTime);
+}
+
+void PNGEncode(const Scene &scene, const Options &opts){
+	u8* render = new u8[opts.renderWidth * opts.renderHeight * opts.renderChannels];
+
+	bool palettizeTiles = opts.palette && opts.palettizeTiles && !opts.denoise.enabled;
+	u8* indices = palettizeTiles ? new u8[opts.renderWidth * opts.renderHeight] : nullptr;
+
+	FrameBuffer frame(opts.renderWidth, opts.renderHeight, opts.halfFloat);
+	GuideBuffers* guides = opts.denoise.enabled ? new GuideBuffers(opts.renderWidth * opts.renderHeight) : nullptr;
+	TileScheduler scheduler(opts.renderWidth, opts.renderHeight, opts.tileSize, renderThreadCount());
+	renderFrame(scene, opts, scheduler, frame, guides, render, indices);
+	reportThreads(scheduler);
 		
 	if(!opts.palette){
+		PhaseTimer encodeTimer;
 		stbi_write_png(opts.renderName.c_str(), opts.renderWidth, opts.renderHeight, opts.renderChannels, render, 0);
-		std::cout << "Time rendered: " << elapsedTime << std::endl;
+		renderStats.encodeTime = encodeTimer.elapsed();
 	}
 	else{
-		writeRenderPalettized(opts.pal, render, opts.renderWidth, opts.renderHeight, opts.renderChannels);
+		if(palettizeTiles)
+			writePaletteImage(opts.pal, indices, opts.renderWidth, opts.renderHeight, opts.renderName, opts.encodeType);
+		else
+			writeRenderPalettized(opts.pal, render, opts.renderWidth, opts.renderHeight, opts.renderChannels, opts.renderName, opts.encodeType);
 		std::cout << "Oh. It was palettized too. Enjoy!" << std::endl;
-		std::cout << "Time rendered: " << elapsedTime << std::endl;
 	}
 	delete[] render;
-}
\ No newline at end of file
+	delete[] indices;
+	delete guides;
+}
+
+std::atomic<bool> stopRequested(false);
+
+//Only the first Ctrl+C is ours. A second one ends things the usual way.
+void requestStop(int){
+	stopRequested = true;
+	std::signal(SIGINT, SIG_DFL);
+}
+
+void writeAccumulated(const AccumulationBuffer &accumulation, const GuideBuffers *guides, const Options &opts, FrameBuffer &frame, u8* render, u8* indices){
+	#pragma omp parallel for
+	for(int i = 0; i < opts.renderWidth * opts.renderHeight; i++){
+		frame.store(i, accumulation.average(i));
+	}
+	finishFrame(frame, guides, opts, render);
+
+	if(!opts.palette){
+		PhaseTimer encodeTimer;
+		stbi_write_png(opts.renderName.c_str(), opts.renderWidth, opts.renderHeight, opts.renderChannels, render, 0);
+		renderStats.encodeTime += encodeTimer.elapsed();
+	}
+	else{
+		palettizeImage(opts.pal, render, indices, opts.renderWidth, opts.renderHeight, opts.renderChannels);
+		writePaletteImage(opts.pal, indices, opts.renderWidth, opts.renderHeight, opts.renderName, opts.encodeType);
+	}
+}
+
+//Adds one sample to every pixel per pass, overwriting the output with a
+//snapshot of the running average whenever one is due. Ctrl+C stops it
+//once each thread is done with the tile it's on, and whatever has been
+//traced by then is written out as the final image.
+void ProgressiveEncode(const Scene &scene, const Options &opts){
+	const ProgressiveSettings &progressive = opts.progressive;
+	u32 pixels = opts.renderWidth * opts.renderHeight;
+	AccumulationBuffer accumulation(opts.renderWidth, opts.renderHeight);
+	FrameBuffer frame(opts.renderWidth, opts.renderHeight, opts.halfFloat);
+	GuideBuffers* guides = opts.denoise.enabled ? new GuideBuffers(pixels) : nullptr;
+	u8* render = new u8[pixels * opts.renderChannels];
+	u8* indices = opts.palette ? new u8[pixels] : nullptr;
+	glm::mat3 rotMat = glm::rotate(glm::radians(opts.camMan.rotation), opts.camMan.rotationAxis);
+
+	stopRequested = false;
+	auto previousHandler = std::signal(SIGINT, requestStop);
+	std::cout << "Rendering progressively, press Ctrl+C to stop early." << std::endl;
+
+	TileScheduler scheduler(opts.renderWidth, opts.renderHeight, opts.tileSize, renderThreadCount());
+	PhaseTimer snapshotTimer;
+	u32 pass = 0, sinceSnapshot = 0;
+	while((progressive.passes == 0 || pass < progressive.passes) && !stopRequested){
+		scheduler.reset();
+		forEachTile(scheduler, [&](const Tile &tile){
+			if(stopRequested)
+				return;
+			for(int y = tile.y0; y < tile.y1; y++){
+				for(int x = tile.x0; x < tile.x1; x++){
+					accumulation.add(x, y, guidedSample(scene, opts, rotMat, x, y, accumulation.samples[x + y * opts.renderWidth], guides));
+				}
+			}
+		});
+		pass++;
+		sinceSnapshot++;
+
+		bool lastPass = stopRequested || pass == progressive.passes;
+		bool due = (progressive.snapshotPasses > 0 && sinceSnapshot >= progressive.snapshotPasses) ||
+				   (progressive.snapshotSeconds > 0.0f && snapshotTimer.elapsed() >= progressive.snapshotSeconds);
+		if(due && !lastPass){
+			writeAccumulated(accumulation, guides, opts, frame, render, indices);
+			std::cout << "Snapshot after " << pass << " passes, " << renderStats.renderTime << "s in." << std::endl;
+			snapshotTimer = PhaseTimer();
+			sinceSnapshot = 0;
+		}
+	}
+	std::signal(SIGINT, previousHandler);
+
+	if(stopRequested)
+		std::cout << "Stopped during pass " << pass << ", " << accumulation.totalSamples() / (float)pixels << " samples per pixel on average." << std::endl;
+	reportThreads(scheduler);
+	writeAccumulated(accumulation, guides, opts, frame, render, indices);
+
+	delete[] render;
+	delete[] indices;
+	delete guides;
+}
+
+//Marks the pixels that get another sample this round and returns how
+//many there are. A pixel counts as noisy if anything in its 3x3
+//neighbourhood is, since two samples that happen to agree on a shadow
+//edge would otherwise call it done. When there are more noisy pixels
+//than budget left, the noisiest ones go first.
+u32 pickNoisyPixels(const AccumulationBuffer &accumulation, const AdaptiveSettings &adaptive, uint64_t budgetLeft, std::vector<u8> &active){
+	int width = accumulation.width, height = accumulation.height;
+	std::vector<float> error((size_t)width * height), noise((size_t)width * height);
+
+	#pragma omp parallel for
+	for(int i = 0; i < width * height; i++){
+		error[i] = accumulation.standardError(i);
+	}
+
+	#pragma omp parallel for
+	for(int y = 0; y < height; y++){
+		for(int x = 0; x < width; x++){
+			float worst = 0.0f;
+			for(int ny = std::max(y - 1, 0); ny <= std::min(y + 1, height - 1); ny++){
+				for(int nx = std::max(x - 1, 0); nx <= std::min(x + 1, width - 1); nx++){
+					worst = std::max(worst, error[nx + ny * width]);
+				}
+			}
+			noise[x + y * width] = worst;
+		}
+	}
+
+	std::vector<u32> noisy;
+	for(u32 i = 0; i < noise.size(); i++){
+		active[i] = noise[i] > adaptive.threshold && accumulation.samples[i] < adaptive.maxSamples;
+		if(active[i])
+			noisy.push_back(i);
+	}
+
+	if(noisy.size() > budgetLeft){
+		std::nth_element(noisy.begin(), noisy.begin() + budgetLeft, noisy.end(), [&](u32 a, u32 b){
+			return noise[a] > noise[b];
+		});
+		for(u32 i = budgetLeft; i < noisy.size(); i++) active[noisy[i]] = 0;
+		return budgetLeft;
+	}
+	return noisy.size();
+}
+
+//Like the progressive render, but after the first few passes each pass
+//only goes over the pixels that are still noisy.
+void AdaptiveEncode(const Scene &scene, const Options &opts){
+	const AdaptiveSettings &adaptive = opts.adaptive;
+	u32 pixels = opts.renderWidth * opts.renderHeight;
+	AccumulationBuffer accumulation(opts.renderWidth, opts.renderHeight);
+	FrameBuffer frame(opts.renderWidth, opts.renderHeight, opts.halfFloat);
+	GuideBuffers* guides = opts.denoise.enabled ? new GuideBuffers(pixels) : nullptr;
+	u8* render = new u8[pixels * opts.renderChannels];
+	u8* indices = opts.palette ? new u8[pixels] : nullptr;
+	glm::mat3 rotMat = glm::rotate(glm::radians(opts.camMan.rotation), opts.camMan.rotationAxis);
+
+	uint64_t budget = std::max<uint64_t>(adaptive.budget * pixels, (uint64_t)adaptive.minSamples * pixels);
+	uint64_t spent = 0;
+	std::vector<u8> active(pixels, 1);
+	u32 activeCount = pixels;
+
+	stopRequested = false;
+	auto previousHandler = std::signal(SIGINT, requestStop);
+
+	TileScheduler scheduler(opts.renderWidth, opts.renderHeight, opts.tileSize, renderThreadCount());
+	u32 pass = 0;
+	while(activeCount > 0 && !stopRequested){
+		scheduler.reset();
+		forEachTile(scheduler, [&](const Tile &tile){
+			if(stopRequested)
+				return;
+			for(int y = tile.y0; y < tile.y1; y++){
+				for(int x = tile.x0; x < tile.x1; x++){
+					u32 index = x + y * opts.renderWidth;
+					if(active[index])
+						accumulation.add(x, y, guidedSample(scene, opts, rotMat, x, y, accumulation.samples[index], guides));
+				}
+			}
+		});
+		spent += activeCount;
+		pass++;
+
+		if(pass >= adaptive.minSamples)
+			activeCount = pickNoisyPixels(accumulation, adaptive, budget - spent, active);
+	}
+	std::signal(SIGINT, previousHandler);
+
+	if(stopRequested)
+		std::cout << "Stopped during pass " << pass << "." << std::endl;
+	u32 fewest = *std::min_element(accumulation.samples.begin(), accumulation.samples.end());
+	u32 most = *std::max_element(accumulation.samples.begin(), accumulation.samples.end());
+	std::cout << "Adaptive sampling took " << pass << " passes: " << accumulation.totalSamples() / (float)pixels 
+			  << " samples per pixel on average, from " << fewest << " to " << most << "." << std::endl;
+	reportThreads(scheduler);
+	writeAccumulated(accumulation, guides, opts, frame, render, indices);
+
+	delete[] render;
+	delete[] indices;
+	delete guides;
+}
+
+//name with its extension swapped for extension, or given one if it has
+//none. Dots in folder names don't count.
+std::string withExtension(const std::string &name, const std::string &extension){
+	size_t dot = name.find_last_of('.'), slash = name.find_last_of("/\\");
+	if(dot == std::string::npos || (slash != std::string::npos && dot < slash))
+		return name + "." + extension;
+	std::string current = name.substr(dot + 1);
+	std::transform(current.begin(), current.end(), current.begin(), ::tolower);
+	return current == extension ? name : name.substr(0, dot + 1) + extension;
+}
+
+//render.png turns into render_0001.png and so on.
+std::string frameName(const std::string &name, u32 frame){
+	std::string number = std::to_string(frame + 1);
+	number.insert(0, number.size() < 4 ? 4 - number.size() : 0, '0');
+	size_t dot = name.find_last_of('.');
+	if(dot == std::string::npos)
+		return name + "_" + number;
+	return name.substr(0, dot) + "_" + number + name.substr(dot);
+}
+
+//Renders every frame of the animation with the one scene and palette,
+//moving the camera and lights between frames. The scene stays as it is,
+//and every frame shades with its own copy of the lights. Palettized
+//animations come out as one GIF or APNG, anything else as numbered PNGs.
+void AnimationEncode(const Scene &scene, const Options &opts, const Animation &animation){
+	Options frameOpts = opts;
+	std::vector<PointLight> frameLights = scene.lights;
+	frameOpts.trace.lights = &frameLights;
+	u32 pixels = opts.renderWidth * opts.renderHeight;
+	FrameBuffer frameBuffer(opts.renderWidth, opts.renderHeight, opts.halfFloat);
+	GuideBuffers* guides = opts.denoise.enabled ? new GuideBuffers(pixels) : nullptr;
+	bool palettizeTiles = opts.palette && opts.palettizeTiles && !opts.denoise.enabled;
+	u8* render = new u8[pixels * opts.renderChannels];
+	u8* indices = opts.palette ? new u8[pixels] : nullptr;
+
+	GIFWriter gif;
+	APNGWriter apng;
+	bool useGIF = opts.encodeType == "gif";
+	if(opts.palette){
+		bool opened = useGIF ? gif.open(opts.renderName, opts.renderWidth, opts.renderHeight, opts.pal.pal, animation.looping)
+							 : apng.open(opts.renderName, opts.renderWidth, opts.renderHeight, opts.pal.pal, animation.frameCount, animation.looping);
+		if(!opened)
+			std::cout << "Couldn't write " << opts.renderName << std::endl;
+	}
+
+	TileScheduler scheduler(opts.renderWidth, opts.renderHeight, opts.tileSize, renderThreadCount());
+	for(u32 frame = 0; frame < animation.frameCount; frame++){
+		Keyframe key = animation.at(frame);
+		frameOpts.camMan.position = key.position;
+		frameOpts.camMan.rotation = key.rotation;
+		frameOpts.camMan.renderFov = key.fov;
+		for(u32 i = 0; i < key.lights.size() && i < frameLights.size(); i++){
+			frameLights[i].origin = key.lights[i];
+		}
+
+		float renderStart = renderStats.renderTime;
+		scheduler.reset();
+		if(guides)
+			*guides = GuideBuffers(pixels);
+		renderFrame(scene, frameOpts, scheduler, frameBuffer, guides, render, palettizeTiles ? indices : nullptr);
+		if(opts.palette && !palettizeTiles)
+			palettizeImage(opts.pal, render, indices, opts.renderWidth, opts.renderHeight, opts.renderChannels);
+
+		PhaseTimer encodeTimer;
+		if(!opts.palette)
+			stbi_write_png(frameName(opts.renderName, frame).c_str(), opts.renderWidth, opts.renderHeight, opts.renderChannels, render, 0);
+		else if(useGIF)
+			gif.addFrame(indices, animation.frameDelay);
+		else
+			apng.addFrame(indices, animation.frameDelay);
+		renderStats.encodeTime += encodeTimer.elapsed();
+
+		std::cout << "Frame " << frame + 1 << " of " << animation.frameCount << " rendered in " << renderStats.renderTime - renderStart << "s" << std::endl;
+	}
+	reportThreads(scheduler);
+
+	if(!opts.palette)
+		std::cout << "Frames went to " << frameName(opts.renderName, 0) << " and onwards." << std::endl;
+	else if(!(useGIF ? gif.finish() : apng.finish()))
+		std::cout << "Couldn't finish writing " << opts.renderName << std::endl;
+	delete[] render;
+	delete[] indices;
+	delete guides;
+}
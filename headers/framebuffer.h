@@ -0,0 +1,195 @@
+#include <cstring>
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+//The render target. Pixels stay linear and unclamped until the resolve
+//stage turns the whole thing into 8 bit color, so bright samples still
+//count for their full weight when they get averaged. Half floats halve
+//the memory for big renders at about three significant digits.
+
+uint16_t floatToHalf(float value){
+#if defined(__F16C__)
+	return _cvtss_sh(value, 0);
+#else
+	uint32_t bits;
+	memcpy(&bits, &value, 4);
+	uint32_t sign = (bits >> 16) & 0x8000, magnitude = bits & 0x7FFFFFFF;
+
+	//Infinity and NaN, then anything that rounds past the biggest half.
+	if(magnitude >= 0x7F800000)
+		return sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0);
+	if(magnitude >= 0x477FF000)
+		return sign | 0x7C00;
+
+	u32 half, remainder, halfway;
+	if(magnitude < 0x38800000){
+		//Too small for a normal half, so it becomes a subnormal or zero.
+		if(magnitude < 0x33000000)
+			return sign;
+		u32 shift = 126 - (magnitude >> 23);
+		u32 mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+		half = mantissa >> shift;
+		remainder = mantissa & ((1u << shift) - 1);
+		halfway = 1u << (shift - 1);
+	}
+	else{
+		half = (magnitude - 0x38000000) >> 13;
+		remainder = magnitude & 0x1FFF;
+		halfway = 0x1000;
+	}
+	//Round to nearest, ties to even. A carry into the exponent is fine.
+	if(remainder > halfway || (remainder == halfway && (half & 1)))
+		half++;
+	return sign | half;
+#endif
+}
+
+float halfToFloat(uint16_t half){
+#if defined(__F16C__)
+	return _cvtsh_ss(half);
+#else
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16, exponent = (half >> 10) & 0x1F, mantissa = half & 0x3FF;
+	if(exponent == 0){
+		float value = mantissa * (1.0f / 16777216.0f);
+		return sign ? -value : value;
+	}
+	uint32_t bits = sign | (exponent == 0x1F ? 0x7F800000 : (exponent + 112) << 23) | (mantissa << 13);
+	float value;
+	memcpy(&value, &bits, 4);
+	return value;
+#endif
+}
+
+struct FrameBuffer{
+	u16 width, height;
+	bool half;
+	std::vector<float> full;
+	std::vector<uint16_t> halves;
+
+	FrameBuffer(u16 w, u16 h, bool useHalf) : width(w), height(h), half(useHalf){
+		if(half)
+			halves.resize((size_t)w * h * 3, 0);
+		else
+			full.resize((size_t)w * h * 3, 0.0f);
+	}
+
+	void store(u32 index, glm::vec3 color){
+		for(int c = 0; c < 3; c++){
+			if(half)
+				halves[index * 3 + c] = floatToHalf(color[c]);
+			else
+				full[index * 3 + c] = color[c];
+		}
+	}
+
+	glm::vec3 load(u32 index) const{
+		if(half)
+			return glm::vec3(halfToFloat(halves[index * 3]), halfToFloat(halves[index * 3 + 1]), halfToFloat(halves[index * 3 + 2]));
+		return glm::vec3(full[index * 3], full[index * 3 + 1], full[index * 3 + 2]);
+	}
+
+	//RGB floats for count pixels starting at index. Half buffers get
+	//unpacked into scratch, which needs room for count * 3 floats.
+	const float* pixels(u32 index, u32 count, float* scratch) const{
+		if(!half)
+			return &full[(size_t)index * 3];
+		for(u32 i = 0; i < count * 3; i++) scratch[i] = halfToFloat(halves[(size_t)index * 3 + i]);
+		return scratch;
+	}
+};
+
+enum TonemapOperator{ClampTonemap, ReinhardTonemap, ACESTonemap};
+
+TonemapOperator parseTonemap(std::string name){
+	if(name == "reinhard") return ReinhardTonemap;
+	if(name == "aces") return ACESTonemap;
+	return ClampTonemap;
+}
+
+struct ResolveSettings{
+	TonemapOperator tonemap = ClampTonemap;
+	float exposure = 1.0f;
+	bool sRGB = false;
+};
+
+//Turns linear color into 8 bit. The curves are plain arithmetic on a
+//run of floats so they vectorize, and the last step to a byte, sRGB
+//included, is one lookup into a table of 4097 steps.
+struct Resolver{
+	ResolveSettings settings;
+	std::vector<u8> encode;
+
+	static constexpr u32 steps = 4096;
+	static constexpr u32 runLength = 64;
+
+	Resolver() : Resolver(ResolveSettings()) {}
+	Resolver(ResolveSettings s) : settings(s), encode(steps + 1){
+		for(u32 i = 0; i <= steps; i++){
+			float value = (float)i / steps;
+			if(settings.sRGB)
+				value = value <= 0.0031308f ? value * 12.92f : 1.055f * powf(value, 1.0f / 2.4f) - 0.055f;
+			encode[i] = value * 255.0f + 0.5f;
+		}
+	}
+
+	//Narkowicz's fit of the ACES filmic curve. The comparisons are
+	//written so a NaN comes out black and an infinity white.
+	template<TonemapOperator op>
+	static float tonemap(float value){
+		value = value > 0.0f ? value : 0.0f;
+		if(op == ReinhardTonemap)
+			value = value / (1.0f + value);
+		else if(op == ACESTonemap)
+			value = (value * (2.51f * value + 0.03f)) / (value * (2.43f * value + 0.59f) + 0.14f);
+		return value < 1.0f ? value : 1.0f;
+	}
+
+	template<TonemapOperator op>
+	void mapRun(const float* in, float* out, u32 count) const{
+		float exposure = settings.exposure;
+		#pragma omp simd
+		for(u32 i = 0; i < count; i++){
+			out[i] = tonemap<op>(in[i] * exposure) * steps + 0.5f;
+		}
+	}
+
+	//count pixels of RGB floats to the channels wide output. Alpha, if
+	//there is one, is opaque.
+	void resolve(const float* in, u8* out, u32 count, u8 channels) const{
+		float mapped[runLength * 3];
+		for(u32 start = 0; start < count; start += runLength){
+			u32 run = std::min(runLength, count - start);
+			const float* source = in + start * 3;
+			switch(settings.tonemap){
+				case ClampTonemap: mapRun<ClampTonemap>(source, mapped, run * 3); break;
+				case ReinhardTonemap: mapRun<ReinhardTonemap>(source, mapped, run * 3); break;
+				case ACESTonemap: mapRun<ACESTonemap>(source, mapped, run * 3); break;
+			}
+			for(u32 i = 0; i < run; i++){
+				u8* pixel = out + (start + i) * channels;
+				pixel[0] = encode[(u32)mapped[i * 3]];
+				pixel[1] = encode[(u32)mapped[i * 3 + 1]];
+				pixel[2] = encode[(u32)mapped[i * 3 + 2]];
+				if(channels > 3)
+					pixel[3] = 255;
+			}
+		}
+	}
+
+	void resolveRegion(const FrameBuffer &frame, u8* render, u8 channels, int x0, int y0, int x1, int y1) const{
+		std::vector<float> scratch(frame.half ? (x1 - x0) * 3 : 0);
+		for(int y = y0; y < y1; y++){
+			u32 index = x0 + y * frame.width;
+			resolve(frame.pixels(index, x1 - x0, scratch.data()), render + index * channels, x1 - x0, channels);
+		}
+	}
+
+	//The whole frame, a row at a time across the threads.
+	void resolveImage(const FrameBuffer &frame, u8* render, u8 channels) const{
+		#pragma omp parallel for
+		for(int y = 0; y < frame.height; y++){
+			resolveRegion(frame, render, channels, 0, y, frame.width, y + 1);
+		}
+	}
+};
@@ -0,0 +1,343 @@
+//Writers for palettized renders. Both formats store the palette once
+//and a small index per pixel instead of full RGB, which is most of the
+//point of palettizing in the first place.
+
+//Standard CRC-32, as used by PNG chunks.
+uint32_t crc32Update(uint32_t crc, const u8* data, size_t length){
+	static uint32_t table[256];
+	static bool tableReady = [](){
+		for(uint32_t n = 0; n < 256; n++){
+			uint32_t c = n;
+			for(int k = 0; k < 8; k++) c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+			table[n] = c;
+		}
+		return true;
+	}();
+	(void)tableReady;
+
+	crc = ~crc;
+	for(size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+	return ~crc;
+}
+
+void writeBigEndian(std::ostream &out, uint32_t value){
+	u8 bytes[4] = {(u8)(value >> 24), (u8)(value >> 16), (u8)(value >> 8), (u8)value};
+	out.write((const char*)bytes, 4);
+}
+
+void writePNGChunk(std::ostream &out, const char* type, const std::vector<u8> &data){
+	writeBigEndian(out, data.size());
+	out.write(type, 4);
+	out.write((const char*)data.data(), data.size());
+	uint32_t crc = crc32Update(0, (const u8*)type, 4);
+	crc = crc32Update(crc, data.data(), data.size());
+	writeBigEndian(out, crc);
+}
+
+//The smallest PNG bit depth that fits every index: 1, 2, 4 or 8.
+u8 indexBitDepth(size_t colorCount){
+	u8 depth = 1;
+	while(depth < 8 && colorCount > (1u << depth)) depth *= 2;
+	return depth;
+}
+
+//Filter type 0 scanlines with indices packed high bits first, ready to
+//be deflated into IDAT.
+std::vector<u8> packScanlines(const u8* indices, u16 width, u16 height, u8 bitDepth){
+	size_t rowBytes = ((size_t)width * bitDepth + 7) / 8;
+	std::vector<u8> scanlines((rowBytes + 1) * height, 0);
+	u8 perByte = 8 / bitDepth;
+	for(int y = 0; y < height; y++){
+		u8* row = &scanlines[(rowBytes + 1) * y + 1];
+		const u8* source = &indices[(size_t)width * y];
+		for(int x = 0; x < width; x++){
+			row[x / perByte] |= source[x] << (8 - bitDepth * (x % perByte + 1));
+		}
+	}
+	return scanlines;
+}
+
+void appendBigEndian(std::vector<u8> &data, uint32_t value){
+	data.push_back(value >> 24);
+	data.push_back(value >> 16);
+	data.push_back(value >> 8);
+	data.push_back(value);
+}
+
+std::vector<u8> headerChunk(u16 width, u16 height, u8 bitDepth){
+	std::vector<u8> header;
+	appendBigEndian(header, width);
+	appendBigEndian(header, height);
+	header.insert(header.end(), {bitDepth, 3, 0, 0, 0});
+	return header;
+}
+
+std::vector<u8> paletteChunk(const std::vector<TrueColor> &colors){
+	std::vector<u8> plte;
+	for(auto &color : colors){
+		plte.push_back(color.R);
+		plte.push_back(color.G);
+		plte.push_back(color.B);
+	}
+	return plte;
+}
+
+std::vector<u8> deflateIndices(const u8* indices, u16 width, u16 height, u8 bitDepth){
+	std::vector<u8> scanlines = packScanlines(indices, width, height, bitDepth);
+	int compressedLength = 0;
+	u8* compressed = stbi_zlib_compress(scanlines.data(), scanlines.size(), &compressedLength, stbi_write_png_compression_level);
+	std::vector<u8> idat(compressed, compressed + compressedLength);
+	STBIW_FREE(compressed);
+	return idat;
+}
+
+const u8 pngSignature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+
+bool writeIndexedPNG(std::string filename, const std::vector<TrueColor> &colors, const u8* indices, u16 width, u16 height){
+	std::ofstream out(filename, std::ios::binary);
+	if(!out)
+		return false;
+
+	u8 bitDepth = indexBitDepth(colors.size());
+	out.write((const char*)pngSignature, 8);
+	writePNGChunk(out, "IHDR", headerChunk(width, height, bitDepth));
+	writePNGChunk(out, "PLTE", paletteChunk(colors));
+	writePNGChunk(out, "IDAT", deflateIndices(indices, width, height, bitDepth));
+	writePNGChunk(out, "IEND", {});
+	return (bool)out;
+}
+
+//Animated PNG. The first frame doubles as the still image that viewers
+//without APNG support show, and every later one goes in fdAT chunks.
+//Frame and data chunks share one sequence count.
+struct APNGWriter{
+	std::ofstream out;
+	u16 width = 0, height = 0;
+	u8 bitDepth = 8;
+	u32 sequence = 0, frames = 0;
+
+	bool open(std::string filename, u16 w, u16 h, const std::vector<TrueColor> &colors, u32 frameCount, bool looping){
+		out.open(filename, std::ios::binary);
+		if(!out)
+			return false;
+
+		width = w;
+		height = h;
+		bitDepth = indexBitDepth(colors.size());
+		sequence = frames = 0;
+
+		std::vector<u8> control;
+		appendBigEndian(control, frameCount);
+		appendBigEndian(control, looping ? 0 : 1);
+
+		out.write((const char*)pngSignature, 8);
+		writePNGChunk(out, "IHDR", headerChunk(width, height, bitDepth));
+		writePNGChunk(out, "acTL", control);
+		writePNGChunk(out, "PLTE", paletteChunk(colors));
+		return (bool)out;
+	}
+
+	//Delay is in hundredths of a second, like the GIF one.
+	void addFrame(const u8* indices, u16 delay){
+		std::vector<u8> control;
+		appendBigEndian(control, sequence++);
+		appendBigEndian(control, width);
+		appendBigEndian(control, height);
+		appendBigEndian(control, 0);
+		appendBigEndian(control, 0);
+		control.insert(control.end(), {(u8)(delay >> 8), (u8)delay, 0, 100, 0, 0});
+		writePNGChunk(out, "fcTL", control);
+
+		std::vector<u8> data = deflateIndices(indices, width, height, bitDepth);
+		if(frames++ == 0){
+			writePNGChunk(out, "IDAT", data);
+		}
+		else{
+			std::vector<u8> frameData;
+			appendBigEndian(frameData, sequence++);
+			frameData.insert(frameData.end(), data.begin(), data.end());
+			writePNGChunk(out, "fdAT", frameData);
+		}
+	}
+
+	bool finish(){
+		writePNGChunk(out, "IEND", {});
+		out.close();
+		return !out.fail();
+	}
+};
+
+//GIF with a global color table and variable width LZW. Frames can be
+//added one after another, which is all an animation needs on top.
+struct GIFWriter{
+	std::ofstream out;
+	u16 width = 0, height = 0;
+	u8 colorBits = 1;
+
+	bool open(std::string filename, u16 w, u16 h, const std::vector<TrueColor> &colors, bool looping){
+		out.open(filename, std::ios::binary);
+		if(!out)
+			return false;
+
+		width = w;
+		height = h;
+		colorBits = 1;
+		while(colorBits < 8 && colors.size() > (1u << colorBits)) colorBits++;
+
+		out.write("GIF89a", 6);
+		writeShort(width);
+		writeShort(height);
+		out.put((char)(0x80 | ((colorBits - 1) << 4) | (colorBits - 1)));
+		out.put(0);
+		out.put(0);
+		for(u32 i = 0; i < (1u << colorBits); i++){
+			TrueColor color = i < colors.size() ? colors[i] : TrueColor(0, 0, 0);
+			out.put(color.R);
+			out.put(color.G);
+			out.put(color.B);
+		}
+
+		//The NETSCAPE2.0 extension, for looping forever.
+		if(looping){
+			const u8 loop[19] = {0x21, 0xFF, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1, 0, 0, 0};
+			out.write((const char*)loop, sizeof(loop));
+		}
+		return (bool)out;
+	}
+
+	void writeShort(u16 value){
+		out.put(value & 0xFF);
+		out.put(value >> 8);
+	}
+
+	//Delay is in hundredths of a second and only matters for animations.
+	void addFrame(const u8* indices, u16 delay = 0){
+		if(delay > 0){
+			const u8 control[4] = {0x21, 0xF9, 4, 0};
+			out.write((const char*)control, 4);
+			writeShort(delay);
+			out.put(0);
+			out.put(0);
+		}
+
+		out.put(0x2C);
+		writeShort(0);
+		writeShort(0);
+		writeShort(width);
+		writeShort(height);
+		out.put(0);
+		writeLZW(indices, (size_t)width * height);
+	}
+
+	void writeLZW(const u8* indices, size_t count){
+		u8 minCodeSize = std::max<u8>(2, colorBits);
+		out.put(minCodeSize);
+
+		const u32 clearCode = 1u << minCodeSize, endCode = clearCode + 1;
+		const u32 maxCodes = 4096;
+
+		//Each code's children by next index, in one flat table.
+		std::vector<u16> children((size_t)maxCodes << colorBits);
+		u32 nextCode = endCode + 1, codeSize = minCodeSize + 1;
+
+		std::vector<u8> block;
+		u32 bitBuffer = 0, bitCount = 0;
+		auto emit = [&](u32 code){
+			bitBuffer |= code << bitCount;
+			bitCount += codeSize;
+			while(bitCount >= 8){
+				block.push_back(bitBuffer & 0xFF);
+				bitBuffer >>= 8;
+				bitCount -= 8;
+				if(block.size() == 255){
+					out.put(255);
+					out.write((const char*)block.data(), 255);
+					block.clear();
+				}
+			}
+		};
+
+		emit(clearCode);
+		if(count > 0){
+			u32 current = indices[0];
+			for(size_t i = 1; i < count; i++){
+				u16 &child = children[((size_t)current << colorBits) + indices[i]];
+				if(child){
+					current = child;
+					continue;
+				}
+
+				emit(current);
+				if(nextCode < maxCodes){
+					//The decoder widens one code later than this, hence the check after.
+					child = nextCode++;
+					if(nextCode > (1u << codeSize) && codeSize < 12)
+						codeSize++;
+				}
+				else{
+					emit(clearCode);
+					std::fill(children.begin(), children.end(), 0);
+					nextCode = endCode + 1;
+					codeSize = minCodeSize + 1;
+				}
+				current = indices[i];
+			}
+			emit(current);
+		}
+		emit(endCode);
+		if(bitCount > 0)
+			block.push_back(bitBuffer & 0xFF);
+		if(!block.empty()){
+			out.put(block.size());
+			out.write((const char*)block.data(), block.size());
+		}
+		out.put(0);
+	}
+
+	bool finish(){
+		out.put(0x3B);
+		out.close();
+		return !out.fail();
+	}
+};
+
+bool writeIndexedGIF(std::string filename, const std::vector<TrueColor> &colors, const u8* indices, u16 width, u16 height){
+	GIFWriter gif;
+	if(!gif.open(filename, width, height, colors, false))
+		return false;
+	gif.addFrame(indices);
+	return gif.finish();
+}
+
+//Writes the indices as a GIF if asked for one, and as an indexed PNG
+//otherwise.
+bool writePaletteImage(const Palette &pal, const u8* indices, u16 imgWidth, u16 imgHeight, std::string filename, std::string format){
+	PhaseTimer encodeTimer;
+	bool written = format == "gif" ? writeIndexedGIF(filename, pal.pal, indices, imgWidth, imgHeight)
+								   : writeIndexedPNG(filename, pal.pal, indices, imgWidth, imgHeight);
+	renderStats.encodeTime += encodeTimer.elapsed();
+	if(!written)
+		std::cout << "Couldn't write " << filename << std::endl;
+	return written;
+}
+
+//Palettizes a finished render in one more pass over the whole image.
+void palettizeImage(const Palette &pal, const u8* data, u8* indices, u16 imgWidth, u16 imgHeight, u8 imgDepth){
+	PhaseTimer palettizeTimer;
+
+	#pragma omp parallel for
+	for(int y = 0; y < imgHeight; y++){
+		palettizeRegion(pal, data, indices, imgWidth, imgDepth, 0, y, imgWidth, y + 1);
+	}
+
+	renderStats.palettizeTime += palettizeTimer.elapsed();
+}
+
+bool writeRenderPalettized(const Palette &pal, const u8* data, u16 imgWidth, u16 imgHeight, u8 imgDepth, std::string filename, std::string format){
+	u8 *indices = new u8[imgWidth * imgHeight];
+	palettizeImage(pal, data, indices, imgWidth, imgHeight, imgDepth);
+
+	bool written = writePaletteImage(pal, indices, imgWidth, imgHeight, filename, format);
+	delete[] indices;
+	return written;
+}
@@ -0,0 +1,202 @@
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "tiny_obj_loader.h"
+
+//Ray setup for the watertight triangle test by Woop, Benthin and Wald.
+//Everything gets sheared so the ray runs down the z axis, which makes
+//the edge tests consistent between triangles that share an edge: no
+//more rays slipping through the cracks between them.
+struct WatertightRay{
+	int kx, ky, kz;
+	float Sx, Sy, Sz;
+	glm::vec3 origin;
+
+	WatertightRay(const Ray &ray) : origin(ray.origin){
+		glm::vec3 absDir = glm::abs(ray.direction);
+		kz = absDir.x > absDir.y ? (absDir.x > absDir.z ? 0 : 2) : (absDir.y > absDir.z ? 1 : 2);
+		kx = (kz + 1) % 3;
+		ky = (kx + 1) % 3;
+		if(ray.direction[kz] < 0.0f) std::swap(kx, ky);
+
+		Sx = ray.direction[kx] / ray.direction[kz];
+		Sy = ray.direction[ky] / ray.direction[kz];
+		Sz = 1.0f / ray.direction[kz];
+	}
+
+	//Both sides of the triangle count.
+	bool intersect(glm::vec3 A, glm::vec3 B, glm::vec3 C, float tMax, float &dist) const{
+		A -= origin;
+		B -= origin;
+		C -= origin;
+
+		float Ax = A[kx] - Sx * A[kz], Ay = A[ky] - Sy * A[kz];
+		float Bx = B[kx] - Sx * B[kz], By = B[ky] - Sy * B[kz];
+		float Cx = C[kx] - Sx * C[kz], Cy = C[ky] - Sy * C[kz];
+
+		float U = Cx * By - Cy * Bx;
+		float V = Ax * Cy - Ay * Cx;
+		float W = Bx * Ay - By * Ax;
+
+		//Right on an edge, so redo it in double to settle which side it's on.
+		if(U == 0.0f || V == 0.0f || W == 0.0f){
+			U = (float)((double)Cx * By - (double)Cy * Bx);
+			V = (float)((double)Ax * Cy - (double)Ay * Cx);
+			W = (float)((double)Bx * Ay - (double)By * Ax);
+		}
+
+		if((U < 0.0f || V < 0.0f || W < 0.0f) && (U > 0.0f || V > 0.0f || W > 0.0f))
+			return false;
+
+		float det = U + V + W;
+		if(det == 0.0f)
+			return false;
+
+		float T = U * Sz * A[kz] + V * Sz * B[kz] + W * Sz * C[kz];
+		float t = T / det;
+		if(t <= EPSILION || t >= tMax)
+			return false;
+
+		dist = t;
+		return true;
+	}
+};
+
+//A triangle mesh loaded from an .obj file. Positions and indices are
+//kept in flat arrays and the scene only ever sees the mesh as a whole,
+//so even a huge model costs about as much as its vertex data plus its
+//own BVH.
+//Normals come from the triangles themselves, and the UV is the
+//barycentric coordinate of the hit.
+struct Mesh{
+	std::vector<glm::vec3> vertices;
+	std::vector<u32> indices;
+	std::vector<BVHNode> nodes;
+	u32 material;
+	u32 depth = 0;
+	float buildTime = 0.0f;
+
+	static constexpr u32 maxLeafSize = 8;
+
+	Mesh(std::string path, glm::vec3 position, float scale, u32 mat) : material(mat){
+		loadObj(path, position, scale);
+		build();
+	}
+
+	bool loadObj(std::string path, glm::vec3 position, float scale){
+		tinyobj::attrib_t attrib;
+		std::vector<tinyobj::shape_t> shapes;
+		std::vector<tinyobj::material_t> materials;
+		std::string warn, err;
+
+		if(!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.c_str())){
+			std::cout << "Couldn't load " << path << ": " << err << std::endl;
+			return false;
+		}
+
+		vertices.resize(attrib.vertices.size() / 3);
+		for(u32 i = 0; i < vertices.size(); i++){
+			vertices[i] = position + scale * glm::vec3(attrib.vertices[i * 3], attrib.vertices[i * 3 + 1], attrib.vertices[i * 3 + 2]);
+		}
+
+		size_t indexCount = 0;
+		for(auto &shape : shapes) indexCount += shape.mesh.indices.size();
+		indices.reserve(indexCount);
+		for(auto &shape : shapes){
+			for(auto &index : shape.mesh.indices){
+				indices.push_back(index.vertex_index);
+			}
+		}
+		return true;
+	}
+
+	u32 triangleCount() const{
+		return indices.size() / 3;
+	}
+
+	void build(){
+		PhaseTimer buildTimer;
+
+		std::vector<AABB> boxes(triangleCount());
+		for(u32 i = 0; i < boxes.size(); i++){
+			boxes[i].grow(vertices[indices[i * 3]]);
+			boxes[i].grow(vertices[indices[i * 3 + 1]]);
+			boxes[i].grow(vertices[indices[i * 3 + 2]]);
+		}
+
+		std::vector<u32> order;
+		BVHBuilder builder(nodes, order, boxes, maxLeafSize);
+		builder.build();
+		depth = builder.depth;
+
+		//Put the triangles in leaf order so a leaf is one contiguous run.
+		std::vector<u32> sorted(indices.size());
+		for(u32 i = 0; i < order.size(); i++){
+			sorted[i * 3] = indices[order[i] * 3];
+			sorted[i * 3 + 1] = indices[order[i] * 3 + 1];
+			sorted[i * 3 + 2] = indices[order[i] * 3 + 2];
+		}
+		indices = sorted;
+
+		buildTime = buildTimer.elapsed();
+	}
+
+	bool intersectTriangle(const WatertightRay &tri, u32 index, float tMax, float &dist) const{
+		return tri.intersect(vertices[indices[index * 3]], vertices[indices[index * 3 + 1]], vertices[indices[index * 3 + 2]], tMax, dist);
+	}
+
+	//Walks the mesh BVH for a triangle closer than tMax, lowering tMax
+	//to each hit. With anyHit it stops at the first one it finds.
+	bool traverse(const Ray &ray, float &tMax, bool anyHit, u32 &part) const{
+		WatertightRay tri(ray);
+		bool found = false;
+
+		traverseBVH(nodes, ray, tMax, [&](u32 first, u32 count, float &closest){
+			for(u32 i = first; i < first + count; i++){
+				float t;
+				if(intersectTriangle(tri, i, closest, t)){
+					closest = t;
+					part = i;
+					found = true;
+					if(anyHit)
+						return true;
+				}
+			}
+			return false;
+		});
+
+		return found;
+	}
+
+	bool occludes(const Ray &ray, float maxDist) const{
+		u32 part;
+		return traverse(ray, maxDist, true, part);
+	}
+
+	glm::vec3 getNormal(glm::vec3 hitPoint, u32 part) const{
+		glm::vec3 A = vertices[indices[part * 3]], B = vertices[indices[part * 3 + 1]], C = vertices[indices[part * 3 + 2]];
+		return glm::normalize(glm::cross(B - A, C - A));
+	}
+
+	glm::vec2 getUV(glm::vec3 hitPoint, u32 part) const{
+		glm::vec3 A = vertices[indices[part * 3]], B = vertices[indices[part * 3 + 1]], C = vertices[indices[part * 3 + 2]];
+		glm::vec3 e1 = B - A, e2 = C - A, p = hitPoint - A;
+		float d11 = glm::dot(e1, e1), d12 = glm::dot(e1, e2), d22 = glm::dot(e2, e2);
+		float p1 = glm::dot(p, e1), p2 = glm::dot(p, e2);
+		float denom = d11 * d22 - d12 * d12;
+		if(denom == 0.0f)
+			return glm::vec2(0.0f);
+		return glm::vec2((d22 * p1 - d12 * p2) / denom, (d11 * p2 - d12 * p1) / denom);
+	}
+
+	AABB getBounds() const{
+		return nodes.empty() ? AABB() : nodes[0].bounds;
+	}
+
+	size_t memoryUsage() const{
+		return vertices.size() * sizeof(glm::vec3) + indices.size() * sizeof(u32) + nodes.size() * sizeof(BVHNode);
+	}
+
+	void printStats() const{
+		std::cout << "Mesh BVH built in " << buildTime * 1000.0f << "ms: " << triangleCount() << " triangles, "
+				  << nodes.size() << " nodes, depth " << depth << ", " << memoryUsage() / (1024.0f * 1024.0f) << "MB" << std::endl;
+	}
+};
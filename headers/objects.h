@@ -1,25 +1,18 @@
-//#define TINYOBJLOADER_IMPLEMENTATION
-//#include "tiny_obj_loader.h"
-
 #include "standardThings.h"
 
 constexpr float EPSILION = 1e-6f;
 
-struct Object{
-	glm::vec3 pos;
-	Material material;
-	Object(glm::vec3 p, Material mat) : pos(p), material(mat) {}
-	Object() = default;
-	virtual bool intersect(Ray ray, float &dist) = 0;
-	virtual glm::vec3 getNormal(glm::vec3 hitPoint) = 0;
-	virtual glm::vec2 getUV(glm::vec3 hitPoint);
-};
+//Each kind of primitive is its own plain struct with nothing virtual in
+//it. The scene keeps one array per kind and the intersection loops are
+//written out per kind, so every call here can be inlined.
 
-struct Sphere : Object{
+struct Sphere{
+	glm::vec3 pos;
 	float radius;
-	Sphere (glm::vec3 c, float r, Material mat) : Object(c, mat), radius(r)  {}
+	u32 material;
+	Sphere (glm::vec3 c, float r, u32 mat) : pos(c), radius(r), material(mat)  {}
 	
-	bool intersect(Ray ray, float &t2){
+	bool intersect(Ray ray, float &t2) const{
 		float radius2 = radius * radius;
 		glm::vec3 L = pos - ray.origin;
 
@@ -40,21 +33,28 @@ struct Sphere : Object{
 		return true;
 	}
 	
-	glm::vec3 getNormal(glm::vec3 hitPoint){
+	glm::vec3 getNormal(glm::vec3 hitPoint) const{
 		return glm::normalize(hitPoint - pos);
 	}
 
-	glm::vec2 getUV(glm::vec3 hitPoint){
+	glm::vec2 getUV(glm::vec3 hitPoint) const{
 		return glm::vec2(glm::atan(hitPoint.x, hitPoint.z) / (2.0f * glm::pi<float>()) + 0.5f, 
 						 glm::asin(hitPoint.y) / glm::pi<float>() + 0.5f); 
 	};
+
+	AABB getBounds() const{
+		return AABB(pos - glm::vec3(radius), pos + glm::vec3(radius));
+	}
 };
 
-struct Plane : Object{
-	glm::vec3 normal;
-	Plane(glm::vec3 p, glm::vec3 n, Material mat) : Object(p, mat), normal(n) {}
+//Planes go on forever, so no box would ever cull them and they get
+//tested against every ray instead.
+struct Plane{
+	glm::vec3 pos, normal;
+	u32 material;
+	Plane(glm::vec3 p, glm::vec3 n, u32 mat) : pos(p), normal(n), material(mat) {}
 	
-	bool intersect(Ray ray, float &dist){
+	bool intersect(Ray ray, float &dist) const{
 		float denom = glm::dot(normal, ray.direction);
 
 		if(abs(denom) > EPSILION){
@@ -64,11 +64,11 @@ struct Plane : Object{
 		return false;
 	}
 
-	glm::vec3 getNormal(glm::vec3 hitPoint){
+	glm::vec3 getNormal(glm::vec3 hitPoint) const{
 		return normal;
 	}
 
-	glm::vec2 getUV(glm::vec3 hitPoint){
+	glm::vec2 getUV(glm::vec3 hitPoint) const{
 		float u = 0.5 + hitPoint.x;
   		float v = 0.5 + hitPoint.z;
 
@@ -76,13 +76,14 @@ struct Plane : Object{
 	};
 };
 
-struct Disk : Object{
-	glm::vec3 normal;
+struct Disk{
+	glm::vec3 pos, normal;
 	float radius;
-	Disk(glm::vec3 p, glm::vec3 n, float rad,Material mat) : Object(p, mat), radius(rad), normal(n) {}
+	u32 material;
+	Disk(glm::vec3 p, glm::vec3 n, float rad, u32 mat) : pos(p), normal(n), radius(rad), material(mat) {}
 	
 
-	bool planeIntersect(Ray ray, float &dist){
+	bool planeIntersect(Ray ray, float &dist) const{
 		float denom = glm::dot(normal, ray.direction);
 
 		if(abs(denom) > EPSILION){
@@ -96,66 +97,35 @@ struct Disk : Object{
 	//square root for checking the hit with the disk's radius. 
 	//Instead, an easy optimization is done similar to
 	//what is done with the sphere intersection.
-	bool intersect(Ray ray, float &dist){
+	bool intersect(Ray ray, float &dist) const{
 		float radius2 = radius * radius;
 		if (planeIntersect(ray, dist)) { 
 			glm::vec3 p = ray.origin + ray.direction * dist; 
-			glm::vec3 v = p - ray.origin; 
-			float d2 = glm::length(v);
+			glm::vec3 v = p - pos; 
+			float d2 = glm::dot(v, v);
 			return d2 <= radius2; 
 		} 
  
      	return false;
 	}
 
-	glm::vec3 getNormal(glm::vec3 hitPoint){
+	glm::vec3 getNormal(glm::vec3 hitPoint) const{
 		return normal;
 	}
 
-	glm::vec2 getUV(glm::vec3 hitPoint){
+	glm::vec2 getUV(glm::vec3 hitPoint) const{
 		glm::vec3 u = glm::normalize(glm::vec3( normal.y, -normal.x, 0));
 		glm::vec3 v = glm::cross(u, normal);
 
 		return glm::vec2(glm::dot(u, hitPoint), glm::dot(v, hitPoint));
 	};
-};
-/*
-struct Triangle : Object{
-	glm::vec3 vertex1, vertex2, vertex3;
-	Triangle(glm::vec3 p1, glm::vec3 p2, glm::vec3 p3, Material mat) : Object(glm::vec3(0.0f), mat), vertex1(p1), vertex2(p2), vertex3(p3) {}
-
-	
-	//thx to Ashley
-	bool intersect(Ray ray, float &dist){
-
-		glm::vec3 v2v1 = vertex2 - vertex1; 
-    	glm::vec3 v3v1 = vertex3 - vertex1; 
-    	glm::vec3 pvec = glm::cross(ray.direction,v3v1); 
-    	float det = glm::dot(v2v1,pvec); 
-
-		if (det < EPSILION) return false;
-
-		float invDet = 1 / det; 
- 
-		glm::vec3 tvec = ray.origin - vertex1; 
-		float u = glm::dot(tvec,pvec) * invDet; 
-		if (u < 0 || u > 1) return false; 
-	
-		glm::vec3 qvec = glm::cross(tvec, v2v1); 
-		float v = glm::dot(ray.direction,qvec) * invDet; 
-		if (v < 0 || u + v > 1) return false; 
-	
-		dist = glm::dot(v3v1,qvec) * invDet; 
-	
-		return true; 
-	}
-
-	//Pretty simple to be fair.
-	glm::vec3 getNormal(glm::vec3 hitPoint){
-		glm::vec3 edge1 = vertex2 - vertex1;
-		glm::vec3 edge2 = vertex3 - vertex1;
 
-		return glm::cross(edge1, edge2);
+	//A disk only spreads out across the axes its normal doesn't point along.
+	AABB getBounds() const{
+		glm::vec3 n = glm::normalize(normal);
+		glm::vec3 extent = radius * glm::vec3(sqrtf(std::max(0.0f, 1.0f - n.x * n.x)),
+											  sqrtf(std::max(0.0f, 1.0f - n.y * n.y)),
+											  sqrtf(std::max(0.0f, 1.0f - n.z * n.z)));
+		return AABB(pos - extent, pos + extent);
 	}
 };
-*/
@@ -0,0 +1,41 @@
+//Counter based random numbers for use inside the render loop. There is
+//no state to share between threads: every value is a hash of the render
+//seed, the pixel, the sample index, the bounce and a running counter, so
+//the same seed always gives the same image no matter who renders what.
+//The mixing is the SplitMix64 finalizer, which is a handful of
+//multiplies and shifts per number.
+
+uint64_t mixBits(uint64_t z){
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+struct RandomStream{
+	uint64_t key;
+	u32 counter = 0;
+
+	RandomStream(uint64_t seed, u32 pixel, u32 sample, u32 bounce){
+		key = mixBits(mixBits(mixBits(seed) ^ pixel) ^ (((uint64_t)sample << 32) | bounce));
+	}
+
+	u32 nextU32(){
+		return mixBits(key + 0x9E3779B97F4A7C15ULL * ++counter) >> 32;
+	}
+
+	//Uniform in [0, 1).
+	float nextFloat(){
+		return (nextU32() >> 8) * (1.0f / 16777216.0f);
+	}
+};
+
+//Identifies one camera sample, so anything down the path can open the
+//stream it needs for a given bounce.
+struct PixelSample{
+	uint64_t seed;
+	u32 pixel, sample;
+
+	RandomStream stream(u32 bounce) const{
+		return RandomStream(seed, pixel, sample, bounce);
+	}
+};
@@ -0,0 +1,190 @@
+//Sample patterns. Each pattern is a fixed low discrepancy point set that
+//gets built once, and every pixel shifts it by its own random offset
+//(a Cranley-Patterson rotation) so neighbouring pixels don't share the
+//same points. That trades the old banding for fine noise, without
+//giving up the even spread within a pixel.
+
+float radicalInverse(u32 base, u32 index){
+	float inverseBase = 1.0f / base, factor = inverseBase, result = 0.0f;
+	while(index > 0){
+		result += (index % base) * factor;
+		index /= base;
+		factor *= inverseBase;
+	}
+	return result;
+}
+
+float wrapUnit(float value){
+	return value - floorf(value);
+}
+
+//Offsets into the volume around a light, which is where the soft shadow
+//technique from Bisqwit's DOS raytracer video picks its points. These
+//are a 3D Hammersley set, which keeps every slab of the cube covered for
+//any sample count.
+struct AreaLightSampler{
+	std::vector<glm::vec3> pattern;
+
+	//Per light and hit, which is already far more than soft shadows need.
+	static constexpr long maxSamples = 256;
+
+	AreaLightSampler() : AreaLightSampler(1) {}
+	AreaLightSampler(u32 count){
+		count = std::max<u32>(count, 1);
+		pattern.resize(count);
+		for(u32 i = 0; i < count; i++){
+			pattern[i] = glm::vec3((i + 0.5f) / count, radicalInverse(2, i), radicalInverse(3, i));
+		}
+	}
+
+	u32 count() const{
+		return pattern.size();
+	}
+
+	//Offset in [-1, 1]^3 for one sample, shifted by this pixel's rotation.
+	glm::vec3 offset(u32 index, glm::vec3 rotation) const{
+		glm::vec3 p = pattern[index] + rotation;
+		return glm::vec3(wrapUnit(p.x), wrapUnit(p.y), wrapUnit(p.z)) * 2.0f - glm::vec3(1.0f);
+	}
+};
+
+//Sub-pixel positions for camera rays. Halton, Sobol and blue noise are
+//progressive, so every prefix of them is spread out too, which suits the
+//adaptive and progressive renders. The grids are built for the sample
+//count and only really pay off when all of it gets used.
+enum SamplePattern{Stratified, RotatedGrid, Halton, Sobol, BlueNoise};
+
+SamplePattern parseSamplePattern(std::string name){
+	if(name == "stratified") return Stratified;
+	if(name == "rotated") return RotatedGrid;
+	if(name == "halton") return Halton;
+	if(name == "bluenoise") return BlueNoise;
+	return Sobol;
+}
+
+//The first two dimensions of the Sobol sequence: a bit reversal, and
+//the one with the direction numbers of x + 1.
+glm::vec2 sobolPoint(u32 index){
+	u32 x = 0, y = 0, direction = 1u << 31;
+	for(u32 bit = 0; index; index >>= 1, bit++, direction ^= direction >> 1){
+		if(index & 1){
+			x ^= 1u << (31 - bit);
+			y ^= direction;
+		}
+	}
+	return glm::vec2(x >> 8, y >> 8) * (1.0f / 16777216.0f);
+}
+
+float toroidalDistance(glm::vec2 a, glm::vec2 b){
+	glm::vec2 d = glm::abs(a - b);
+	d = glm::min(d, glm::vec2(1.0f) - d);
+	return glm::dot(d, d);
+}
+
+struct PixelSampler{
+	std::vector<glm::vec2> pattern;
+
+	PixelSampler() : PixelSampler(Sobol, 1) {}
+	PixelSampler(SamplePattern type, u32 count){
+		count = std::max<u32>(count, 1);
+		switch(type){
+			case Stratified: stratified(count); break;
+			case RotatedGrid: rotatedGrid(count); break;
+			case Halton:
+				for(u32 i = 0; i < count; i++) pattern.push_back(glm::vec2(radicalInverse(2, i), radicalInverse(3, i)));
+				break;
+			case Sobol:
+				for(u32 i = 0; i < count; i++) pattern.push_back(sobolPoint(i));
+				break;
+			case BlueNoise: blueNoise(count); break;
+		}
+	}
+
+	//Multi-jittered sampling (Chiu, Shirley and Wang): a rows by columns
+	//grid with exactly count cells, so every cell gets a point, and the
+	//points also fall one apart into count strips along x and along y.
+	//Counts with no factors close to square, like primes, end up as one
+	//row, where the strips still keep y spread out. The shuffle and the
+	//jitter are fixed, each pixel still gets its own shift on top.
+	void stratified(u32 count){
+		RandomStream rng(0, 0, 0, 0);
+		u32 rows = sqrtf(count);
+		while(count % rows) rows--;
+		u32 columns = count / rows;
+
+		//Which of the fine strips inside its cell each point sits in. Each
+		//column has to use all of its rows' x strips once, and each row
+		//all of its columns' y strips, so only shuffle within those.
+		std::vector<u32> stripX(count), stripY(count);
+		for(u32 j = 0; j < rows; j++){
+			for(u32 i = 0; i < columns; i++){
+				stripX[j * columns + i] = j;
+				stripY[j * columns + i] = i;
+			}
+		}
+		for(u32 i = 0; i < columns; i++){
+			for(u32 j = rows - 1; j > 0; j--){
+				u32 other = std::min<u32>(rng.nextFloat() * (j + 1), j);
+				std::swap(stripX[j * columns + i], stripX[other * columns + i]);
+			}
+		}
+		for(u32 j = 0; j < rows; j++){
+			for(u32 i = columns - 1; i > 0; i--){
+				u32 other = std::min<u32>(rng.nextFloat() * (i + 1), i);
+				std::swap(stripY[j * columns + i], stripY[j * columns + other]);
+			}
+		}
+
+		for(u32 j = 0; j < rows; j++){
+			for(u32 i = 0; i < columns; i++){
+				u32 cell = j * columns + i;
+				glm::vec2 jitter(rng.nextFloat(), rng.nextFloat());
+				pattern.push_back(glm::vec2((i + (stripX[cell] + jitter.x) / rows) / columns, (j + (stripY[cell] + jitter.y) / columns) / rows));
+			}
+		}
+	}
+
+	//A k by k grid turned by atan(1 / k), which lands every point in its
+	//own row and column of the k^2 fine grid. k = 2 is the classic four
+	//sample rotated grid. Counts that aren't squares take evenly spaced
+	//points out of the next bigger one.
+	void rotatedGrid(u32 count){
+		u32 k = ceilf(sqrtf(count)), total = k * k;
+		for(u32 i = 0; i < count; i++){
+			u32 point = (uint64_t)i * total / count;
+			u32 a = point / k, b = point % k;
+			pattern.push_back(glm::vec2(a * k + b + 0.5f, b * k + (k - 1 - a) + 0.5f) / (float)total);
+		}
+	}
+
+	//Mitchell's best candidate, wrapping around the edges so it tiles:
+	//each new point is whichever of a handful of random candidates is
+	//furthest from all the points so far.
+	void blueNoise(u32 count){
+		RandomStream rng(0, 0, 0, 0);
+		for(u32 i = 0; i < count; i++){
+			glm::vec2 best;
+			float bestDistance = -1.0f;
+			for(u32 c = 0; c < 4 * i + 1; c++){
+				glm::vec2 candidate(rng.nextFloat(), rng.nextFloat());
+				float closest = std::numeric_limits<float>::max();
+				for(auto &point : pattern) closest = std::min(closest, toroidalDistance(candidate, point));
+				if(closest > bestDistance){
+					bestDistance = closest;
+					best = candidate;
+				}
+			}
+			pattern.push_back(best);
+		}
+	}
+
+	u32 count() const{
+		return pattern.size();
+	}
+
+	//Position within the pixel, in [0, 1)^2, shifted by the pixel's rotation.
+	glm::vec2 offset(u32 index, glm::vec2 rotation) const{
+		glm::vec2 p = pattern[index % pattern.size()] + rotation;
+		return glm::vec2(wrapUnit(p.x), wrapUnit(p.y));
+	}
+};
@@ -0,0 +1,165 @@
+//Everything a render needs to know about the world. It holds the
+//textures, materials, primitives and lights by value, and gets filled
+//in once before build() puts the BVHs together. After that it's only
+//ever handed around by const reference, so no ray has to copy a thing.
+//
+//Each kind of primitive has its own array and its own BVH, and the
+//queries below walk them one kind after another with the intersection
+//code for that kind written right into the leaf. The closest hit so far
+//carries over from one kind to the next, so later trees get culled by
+//whatever the earlier ones already found.
+//
+//Intersection only ever works out distances. The winner is kept as a
+//PrimitiveHit, and normal, UV and material get looked up once for it
+//afterwards in surfaceAt().
+
+enum PrimitiveKind : u8 {PlaneKind, SphereKind, DiskKind, MeshKind};
+
+struct PrimitiveHit{
+	float dist;
+	u32 index; //Into the array for this kind.
+	u32 part;  //Which triangle, for meshes.
+	PrimitiveKind kind;
+};
+
+struct Scene{
+	std::vector<Texture> textures;
+	std::vector<Material> materials;
+	std::vector<PointLight> lights;
+
+	std::vector<Plane> planes;
+	std::vector<Sphere> spheres;
+	std::vector<Disk> disks;
+	std::vector<Mesh> meshes;
+
+	PrimitiveBVH sphereBVH, diskBVH, meshBVH;
+	SphereStore sphereStore;
+	float buildTime = 0.0f;
+
+	static constexpr u32 maxLeafSize = SphereStore::width;
+
+	Scene() = default;
+	Scene(const Scene&) = delete;
+	Scene& operator=(const Scene&) = delete;
+
+	void build(){
+		PhaseTimer buildTimer;
+		sphereBVH.build(spheres, maxLeafSize);
+		diskBVH.build(disks, maxLeafSize);
+		meshBVH.build(meshes, maxLeafSize);
+		sphereStore.build(spheres);
+		buildTime = buildTimer.elapsed();
+	}
+
+	bool intersect(const Ray &ray, PrimitiveHit &hit) const{
+		float closest = std::numeric_limits<float>::max();
+
+		threadCounters.intersectionTests += planes.size();
+		for(u32 i = 0; i < planes.size(); i++){
+			float dist;
+			if(planes[i].intersect(ray, dist) && dist < closest){
+				closest = dist;
+				hit = {dist, i, 0, PlaneKind};
+			}
+		}
+
+		sphereBVH.traverse(ray, closest, [&](u32 first, u32 count, float &tMax){
+			int index = sphereStore.nearest(ray, first, count, tMax);
+			if(index >= 0)
+				hit = {tMax, (u32)index, 0, SphereKind};
+			return false;
+		});
+
+		diskBVH.traverse(ray, closest, [&](u32 first, u32 count, float &tMax){
+			for(u32 i = first; i < first + count; i++){
+				float dist;
+				if(disks[i].intersect(ray, dist) && dist < tMax){
+					tMax = dist;
+					hit = {dist, i, 0, DiskKind};
+				}
+			}
+			return false;
+		});
+
+		meshBVH.traverse(ray, closest, [&](u32 first, u32 count, float &tMax){
+			for(u32 i = first; i < first + count; i++){
+				u32 part;
+				if(meshes[i].traverse(ray, tMax, false, part))
+					hit = {tMax, i, part, MeshKind};
+			}
+			return false;
+		});
+
+		return closest < std::numeric_limits<float>::max();
+	}
+
+	//Everything shading wants to know about the point a ray ended up at.
+	hitHistory surfaceAt(const Ray &ray, const PrimitiveHit &hit) const{
+		glm::vec3 hitPoint = ray.origin + ray.direction * hit.dist;
+		hitHistory history;
+		switch(hit.kind){
+			case PlaneKind:
+				history = hitHistory(hit.dist, hitPoint, planes[hit.index].getNormal(hitPoint), planes[hit.index].material);
+				history.UV = planes[hit.index].getUV(hitPoint);
+				break;
+			case SphereKind:
+				history = hitHistory(hit.dist, hitPoint, spheres[hit.index].getNormal(hitPoint), spheres[hit.index].material);
+				history.UV = spheres[hit.index].getUV(hitPoint);
+				break;
+			case DiskKind:
+				history = hitHistory(hit.dist, hitPoint, disks[hit.index].getNormal(hitPoint), disks[hit.index].material);
+				history.UV = disks[hit.index].getUV(hitPoint);
+				break;
+			case MeshKind:
+				history = hitHistory(hit.dist, hitPoint, meshes[hit.index].getNormal(hitPoint, hit.part), meshes[hit.index].material);
+				history.UV = meshes[hit.index].getUV(hitPoint, hit.part);
+				break;
+		}
+		return history;
+	}
+
+	//Any-hit query: bails out on the first thing closer than maxDist
+	//without ever working out normals or UVs.
+	bool occluded(const Ray &ray, float maxDist) const{
+		threadCounters.intersectionTests += planes.size();
+		for(auto &plane : planes){
+			float dist;
+			if(plane.intersect(ray, dist) && dist < maxDist)
+				return true;
+		}
+
+		bool blocked = false;
+		sphereBVH.traverse<false>(ray, maxDist, [&](u32 first, u32 count, float &tMax){
+			return blocked = sphereStore.occluded(ray, first, count, tMax);
+		});
+		if(blocked)
+			return true;
+
+		diskBVH.traverse<false>(ray, maxDist, [&](u32 first, u32 count, float &tMax){
+			for(u32 i = first; i < first + count; i++){
+				float dist;
+				if(disks[i].intersect(ray, dist) && dist < tMax)
+					return blocked = true;
+			}
+			return false;
+		});
+		if(blocked)
+			return true;
+
+		meshBVH.traverse<false>(ray, maxDist, [&](u32 first, u32 count, float &tMax){
+			for(u32 i = first; i < first + count; i++){
+				if(meshes[i].occludes(ray, tMax))
+					return blocked = true;
+			}
+			return false;
+		});
+		return blocked;
+	}
+
+	void printStats() const{
+		std::cout << "Scene BVHs built in " << buildTime * 1000.0f << "ms: "
+				  << spheres.size() << " spheres (" << sphereBVH.nodes.size() << " nodes, depth " << sphereBVH.depth << "), "
+				  << disks.size() << " disks (" << diskBVH.nodes.size() << " nodes, depth " << diskBVH.depth << "), "
+				  << meshes.size() << " meshes and " << planes.size() << " planes." << std::endl;
+	}
+};
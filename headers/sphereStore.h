@@ -0,0 +1,171 @@
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+//Spheres packed as separate float arrays, so one ray can be tested
+//against a whole BVH leaf at once instead of one sphere at a time.
+//Slots line up with Scene::spheres, and the arrays are padded past the
+//end so the wide loads never read out of bounds.
+struct SphereStore{
+	static constexpr u32 width = 8;
+
+	std::vector<float> centerX, centerY, centerZ, radius;
+
+	void build(const std::vector<Sphere> &spheres){
+		u32 padded = spheres.size() + width;
+		centerX.assign(padded, 0.0f);
+		centerY.assign(padded, 0.0f);
+		centerZ.assign(padded, 0.0f);
+		radius.assign(padded, 0.0f);
+
+		for(u32 i = 0; i < spheres.size(); i++){
+			centerX[i] = spheres[i].pos.x;
+			centerY[i] = spheres[i].pos.y;
+			centerZ[i] = spheres[i].pos.z;
+			radius[i] = spheres[i].radius;
+		}
+	}
+
+	//Nearest hit among spheres [first, first + count) closer than dist.
+	//Returns the slot that got hit, or -1 and leaves dist alone.
+	int nearest(const Ray &ray, u32 first, u32 count, float &dist) const{
+		int hitIndex = -1;
+		u32 i = 0;
+#if defined(__AVX2__)
+		__m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+		__m256 dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y), dz = _mm256_set1_ps(ray.direction.z);
+		const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		for(; i < count; i += 8){
+			__m256 t = hit8(first + i, ox, oy, oz, dx, dy, dz);
+			__m256 valid = _mm256_cmp_ps(lanes, _mm256_set1_ps((float)(count - i)), _CMP_LT_OQ);
+			__m256 closer = _mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(dist), _CMP_LT_OQ));
+			int mask = _mm256_movemask_ps(closer);
+			while(mask){
+				int lane = __builtin_ctz(mask);
+				mask &= mask - 1;
+				float laneDist = ((float*)&t)[lane];
+				if(laneDist < dist){
+					dist = laneDist;
+					hitIndex = first + i + lane;
+				}
+			}
+		}
+#elif defined(__SSE2__)
+		__m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+		__m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+		const __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+		for(; i < count; i += 4){
+			__m128 t = hit4(first + i, ox, oy, oz, dx, dy, dz);
+			__m128 valid = _mm_cmplt_ps(lanes, _mm_set1_ps((float)(count - i)));
+			__m128 closer = _mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(dist)));
+			int mask = _mm_movemask_ps(closer);
+			while(mask){
+				int lane = __builtin_ctz(mask);
+				mask &= mask - 1;
+				float laneDist = ((float*)&t)[lane];
+				if(laneDist < dist){
+					dist = laneDist;
+					hitIndex = first + i + lane;
+				}
+			}
+		}
+#else
+		for(; i < count; i++){
+			float t = hit1(first + i, ray);
+			if(t < dist){
+				dist = t;
+				hitIndex = first + i;
+			}
+		}
+#endif
+		return hitIndex;
+	}
+
+	//Whether any sphere in [first, first + count) is hit closer than maxDist.
+	bool occluded(const Ray &ray, u32 first, u32 count, float maxDist) const{
+		u32 i = 0;
+#if defined(__AVX2__)
+		__m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+		__m256 dx = _mm256_set1_ps(ray.direction.x), dy = _mm256_set1_ps(ray.direction.y), dz = _mm256_set1_ps(ray.direction.z);
+		const __m256 lanes = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+		for(; i < count; i += 8){
+			__m256 t = hit8(first + i, ox, oy, oz, dx, dy, dz);
+			__m256 valid = _mm256_cmp_ps(lanes, _mm256_set1_ps((float)(count - i)), _CMP_LT_OQ);
+			if(_mm256_movemask_ps(_mm256_and_ps(valid, _mm256_cmp_ps(t, _mm256_set1_ps(maxDist), _CMP_LT_OQ))))
+				return true;
+		}
+#elif defined(__SSE2__)
+		__m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+		__m128 dx = _mm_set1_ps(ray.direction.x), dy = _mm_set1_ps(ray.direction.y), dz = _mm_set1_ps(ray.direction.z);
+		const __m128 lanes = _mm_setr_ps(0, 1, 2, 3);
+		for(; i < count; i += 4){
+			__m128 t = hit4(first + i, ox, oy, oz, dx, dy, dz);
+			__m128 valid = _mm_cmplt_ps(lanes, _mm_set1_ps((float)(count - i)));
+			if(_mm_movemask_ps(_mm_and_ps(valid, _mm_cmplt_ps(t, _mm_set1_ps(maxDist)))))
+				return true;
+		}
+#else
+		for(; i < count; i++){
+			if(hit1(first + i, ray) < maxDist)
+				return true;
+		}
+#endif
+		return false;
+	}
+
+	//Same math as Sphere::intersect, with misses coming out as infinity.
+#if defined(__AVX2__)
+	__m256 hit8(u32 index, __m256 ox, __m256 oy, __m256 oz, __m256 dx, __m256 dy, __m256 dz) const{
+		__m256 lx = _mm256_sub_ps(_mm256_loadu_ps(&centerX[index]), ox);
+		__m256 ly = _mm256_sub_ps(_mm256_loadu_ps(&centerY[index]), oy);
+		__m256 lz = _mm256_sub_ps(_mm256_loadu_ps(&centerZ[index]), oz);
+		__m256 r = _mm256_loadu_ps(&radius[index]);
+		__m256 radius2 = _mm256_mul_ps(r, r);
+
+		__m256 tca = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, dx), _mm256_mul_ps(ly, dy)), _mm256_mul_ps(lz, dz));
+		__m256 ll = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(lx, lx), _mm256_mul_ps(ly, ly)), _mm256_mul_ps(lz, lz));
+		__m256 d2 = _mm256_sub_ps(ll, _mm256_mul_ps(tca, tca));
+		__m256 inside = _mm256_cmp_ps(d2, radius2, _CMP_LE_OQ);
+
+		__m256 thc = _mm256_sqrt_ps(_mm256_max_ps(_mm256_sub_ps(radius2, d2), _mm256_setzero_ps()));
+		__m256 t0 = _mm256_sub_ps(tca, thc), t1 = _mm256_add_ps(tca, thc);
+		__m256 zero = _mm256_setzero_ps();
+		__m256 t = _mm256_blendv_ps(t0, t1, _mm256_cmp_ps(t0, zero, _CMP_LT_OQ));
+		__m256 hit = _mm256_and_ps(inside, _mm256_cmp_ps(t, zero, _CMP_GE_OQ));
+		return _mm256_blendv_ps(_mm256_set1_ps(std::numeric_limits<float>::infinity()), t, hit);
+	}
+#elif defined(__SSE2__)
+	__m128 hit4(u32 index, __m128 ox, __m128 oy, __m128 oz, __m128 dx, __m128 dy, __m128 dz) const{
+		__m128 lx = _mm_sub_ps(_mm_loadu_ps(&centerX[index]), ox);
+		__m128 ly = _mm_sub_ps(_mm_loadu_ps(&centerY[index]), oy);
+		__m128 lz = _mm_sub_ps(_mm_loadu_ps(&centerZ[index]), oz);
+		__m128 r = _mm_loadu_ps(&radius[index]);
+		__m128 radius2 = _mm_mul_ps(r, r);
+
+		__m128 tca = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, dx), _mm_mul_ps(ly, dy)), _mm_mul_ps(lz, dz));
+		__m128 ll = _mm_add_ps(_mm_add_ps(_mm_mul_ps(lx, lx), _mm_mul_ps(ly, ly)), _mm_mul_ps(lz, lz));
+		__m128 d2 = _mm_sub_ps(ll, _mm_mul_ps(tca, tca));
+		__m128 inside = _mm_cmple_ps(d2, radius2);
+
+		__m128 thc = _mm_sqrt_ps(_mm_max_ps(_mm_sub_ps(radius2, d2), _mm_setzero_ps()));
+		__m128 t0 = _mm_sub_ps(tca, thc), t1 = _mm_add_ps(tca, thc);
+		__m128 zero = _mm_setzero_ps();
+		__m128 useFar = _mm_cmplt_ps(t0, zero);
+		__m128 t = _mm_or_ps(_mm_and_ps(useFar, t1), _mm_andnot_ps(useFar, t0));
+		__m128 hit = _mm_and_ps(inside, _mm_cmpge_ps(t, zero));
+		return _mm_or_ps(_mm_and_ps(hit, t), _mm_andnot_ps(hit, _mm_set1_ps(std::numeric_limits<float>::infinity())));
+	}
+#else
+	float hit1(u32 index, const Ray &ray) const{
+		glm::vec3 L = glm::vec3(centerX[index], centerY[index], centerZ[index]) - ray.origin;
+		float radius2 = radius[index] * radius[index];
+		float tca = glm::dot(L, ray.direction), d2 = glm::dot(L, L) - tca * tca;
+		if(d2 > radius2) return std::numeric_limits<float>::infinity();
+
+		float thc = sqrtf(radius2 - d2);
+		float t0 = tca - thc, t1 = tca + thc;
+		float t = t0 < 0 ? t1 : t0;
+		return t >= 0 ? t : std::numeric_limits<float>::infinity();
+	}
+#endif
+};
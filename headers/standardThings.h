@@ -9,50 +9,91 @@ struct Ray{
 	Ray() = default;
 };
 
-enum MaterialType{Standard, Reflective};
+struct AABB{
+	glm::vec3 min = glm::vec3(std::numeric_limits<float>::max());
+	glm::vec3 max = glm::vec3(-std::numeric_limits<float>::max());
+	AABB(glm::vec3 mi, glm::vec3 ma) : min(mi), max(ma) {}
+	AABB() = default;
+
+	void grow(glm::vec3 point){
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const AABB &other){
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 center() const{
+		return (min + max) * 0.5f;
+	}
+
+	//Half of the surface area, which is all the SAH cares about.
+	float halfArea() const{
+		glm::vec3 e = max - min;
+		return e.x * e.y + e.y * e.z + e.z * e.x;
+	}
 
-struct Texture{
-	virtual ~Texture() = default;
-	virtual glm::vec3 returnColor(float u, float v, glm::vec3 point) = 0;
+	//Slab test against an interval, using the precomputed inverse direction.
+	bool hit(const Ray &ray, glm::vec3 invDir, float tMax) const{
+		glm::vec3 t0 = (min - ray.origin) * invDir;
+		glm::vec3 t1 = (max - ray.origin) * invDir;
+		glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+		float enter = std::max(std::max(tNear.x, tNear.y), tNear.z);
+		float exit = std::min(std::min(tFar.x, tFar.y), tFar.z);
+		return enter <= exit && exit >= 0.0f && enter < tMax;
+	}
 };
 
-struct SolidTexture : Texture{
+enum MaterialType{Standard, Reflective};
+
+//Textures are plain structs held by value in a variant, so looking up a
+//color is a switch on the tag instead of a virtual call through a pointer.
+struct SolidTexture{
 	glm::vec3 color;
 	SolidTexture(glm::vec3 c) : color(c){}
-	glm::vec3 returnColor(float u, float v, glm::vec3 point){
+	glm::vec3 returnColor(float u, float v, glm::vec3 point) const{
 		return color;
 	}
 };
 
-struct CheckerTexture : Texture{
+struct CheckerTexture{
 	glm::vec3 color, secondColor;
 	int checkerScale;
 	CheckerTexture(glm::vec3 c, glm::vec3 c2, int scale) : color(c), secondColor(c2), checkerScale(scale) {}
-	glm::vec3 returnColor(float u, float v, glm::vec3 point){
+	glm::vec3 returnColor(float u, float v, glm::vec3 point) const{
 		glm::vec2 uv = glm::vec2(glm::atan(point.x, point.z) / (2.0f * glm::pi<float>()) + 0.5f, glm::asin(point.y) / glm::pi<float>() + 0.5f); 
 		
 		return (int)(floor(16.0f * uv.x) + floor(10.0f * uv.y)) % 2 ? secondColor : color;
 	}
 };
 
-struct PerlinTexture : Texture{
+struct PerlinTexture{
 	float lac, gain;
 	int octaves;
 	PerlinTexture(float la, float ga, int oc) : lac(la), gain(ga), octaves(oc) {}
-	glm::vec3 returnColor(float u, float v, glm::vec3 point){
+	glm::vec3 returnColor(float u, float v, glm::vec3 point) const{
 		return glm::vec3(stb_perlin_turbulence_noise3(point.x, point.y, point.z, lac, gain, octaves));
 	}
 };
 
-struct ImageTexture : Texture{
-	u8* imageData;
-	int imageWidth, imageHeight, imageDepth;
+struct ImageTexture{
+	std::vector<u8> imageData;
+	int imageWidth = 0, imageHeight = 0, imageDepth = 0;
 	
 	ImageTexture(std::string imagePath){
-		imageData = stbi_load(imagePath.c_str(), &imageWidth, &imageHeight, &imageDepth, 0);
+		u8 *data = stbi_load(imagePath.c_str(), &imageWidth, &imageHeight, &imageDepth, 0);
+		if(data){
+			imageData.assign(data, data + imageWidth * imageHeight * imageDepth);
+			stbi_image_free(data);
+		}
 	}
 
-	glm::vec3 returnColor(float u, float v, glm::vec3 point){
+	glm::vec3 returnColor(float u, float v, glm::vec3 point) const{
+		if(imageData.empty())
+			return glm::vec3(0.0f);
+
 		int i = (int)fabs((float)imageWidth * (v - ((int)v)));
 		int j = (int)fabs((float)imageHeight * (u - ((int)u)));
 
@@ -63,11 +104,19 @@ struct ImageTexture : Texture{
 	}
 };
 
+typedef std::variant<SolidTexture, CheckerTexture, PerlinTexture, ImageTexture> Texture;
+
+glm::vec3 textureColor(const Texture &texture, float u, float v, glm::vec3 point){
+	return std::visit([&](const auto &tex){ return tex.returnColor(u, v, point); }, texture);
+}
+
+//Materials and everything that uses them refer to each other by index
+//into the scene's arrays.
 struct Material{
-	Texture *diffuse;
+	u32 diffuse;
 	float reflectiveness;
 	MaterialType type;
-	Material(Texture *diff, float ref, MaterialType typ) : diffuse(diff), reflectiveness(ref), type(typ) {}
+	Material(u32 diff, float ref, MaterialType typ) : diffuse(diff), reflectiveness(ref), type(typ) {}
 	Material() = default;
 };
 
@@ -75,50 +124,43 @@ struct hitHistory{
 	float dist;
 	glm::vec3 hitPoint, normal;
 	glm::vec2 UV;
-	Material *obtMat;
-	hitHistory(float d, glm::vec3 hP, glm::vec3 n, Material &oM) : dist(d), hitPoint(hP), normal(n), obtMat(&oM) {}
+	u32 obtMat;
+	hitHistory(float d, glm::vec3 hP, glm::vec3 n, u32 oM) : dist(d), hitPoint(hP), normal(n), obtMat(oM) {}
 	hitHistory() = default;
 };
 
-struct Light{
-	glm::vec3 color;
+//Only point lights for now, so the scene keeps them in one flat array
+//and the light loop calls straight into them.
+struct PointLight{
+	glm::vec3 origin, color;
 	float intensity;
-	Light(glm::vec3 c, float i) : color(c), intensity(i) {}
-	virtual ~Light() = default;
-
-	virtual glm::vec3 lightDirection(glm::vec3 point, glm::vec3 areaPoint) = 0;
-	virtual float lightDistance(glm::vec3 point, glm::vec3 areaPoint) = 0;
-	virtual float attenuation(float distance) = 0;
-};
-
-struct PointLight : Light{
-	glm::vec3 origin;
-	PointLight(glm::vec3 p, glm::vec3 c, float i) : origin(p), Light(c, i) {}
-	glm::vec3 lightDirection(glm::vec3 point, glm::vec3 areaPoint){
+	PointLight(glm::vec3 p, glm::vec3 c, float i) : origin(p), color(c), intensity(i) {}
+	glm::vec3 lightDirection(glm::vec3 point, glm::vec3 areaPoint) const{
 		return glm::normalize((origin + areaPoint) - point);
 	}
 
-	float lightDistance(glm::vec3 point, glm::vec3 areaPoint){
+	float lightDistance(glm::vec3 point, glm::vec3 areaPoint) const{
 		return glm::length((origin + areaPoint)- point);
 	}
-	float attenuation(float distance){
+	float attenuation(float distance) const{
 		return (1.0f + 0.09f * distance + 0.032f * (distance * distance));
 	}
 };
 
 /*
-struct SunLight : Light{
-	glm::vec3 direction;
-	SunLight(glm::vec3 d, glm::vec3 c, float i) : direction(d), Light(c, i) {}
-	glm::vec3 lightDirection(glm::vec3 point){
+struct SunLight{
+	glm::vec3 direction, color;
+	float intensity;
+	SunLight(glm::vec3 d, glm::vec3 c, float i) : direction(d), color(c), intensity(i) {}
+	glm::vec3 lightDirection(glm::vec3 point) const{
 		return direction;
 	}
 
-	float lightDistance(glm::vec3 point){
+	float lightDistance(glm::vec3 point) const{
 		return std::numeric_limits<float>::max();
 	}
 
-	float attenuation(float distance){
+	float attenuation(float distance) const{
 		return 1.0f;
 	}
 };
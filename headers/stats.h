@@ -0,0 +1,89 @@
+//Render statistics. Counters are bumped in a thread local copy so the
+//hot loops never touch shared memory, and each thread folds its copy
+//into renderStats once its part of the render is done.
+
+struct PhaseTimer{
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	float elapsed() const{
+		std::chrono::duration<float> delta = std::chrono::steady_clock::now() - start;
+		return delta.count();
+	}
+};
+
+struct RayCounters{
+	uint64_t primaryRays = 0, shadowRays = 0, reflectionRays = 0;
+	uint64_t intersectionTests = 0, textureLookups = 0;
+
+	void merge(const RayCounters &other){
+		primaryRays += other.primaryRays;
+		shadowRays += other.shadowRays;
+		reflectionRays += other.reflectionRays;
+		intersectionTests += other.intersectionTests;
+		textureLookups += other.textureLookups;
+	}
+
+	uint64_t totalRays() const{
+		return primaryRays + shadowRays + reflectionRays;
+	}
+};
+
+thread_local RayCounters threadCounters;
+
+struct ThreadReport{
+	float busy, idle;
+};
+
+struct RenderStats{
+	RayCounters counters;
+	float sceneBuildTime = 0.0f, renderTime = 0.0f, denoiseTime = 0.0f, resolveTime = 0.0f, palettizeTime = 0.0f, encodeTime = 0.0f;
+	std::vector<ThreadReport> threads;
+
+	//Call from every thread at the end of a parallel region.
+	void gatherThread(){
+		#pragma omp critical(renderStatsMerge)
+		counters.merge(threadCounters);
+		threadCounters = RayCounters();
+	}
+
+	double raysPerSecond() const{
+		return renderTime > 0.0f ? counters.totalRays() / renderTime : 0.0;
+	}
+
+	void print() const{
+		std::cout << "Scene built in " << sceneBuildTime << "s, rendered in " << renderTime << "s";
+		if(denoiseTime > 0.0f)
+			std::cout << ", denoised in " << denoiseTime << "s";
+		if(resolveTime > 0.0f)
+			std::cout << ", resolved in " << resolveTime << "s";
+		if(palettizeTime > 0.0f)
+			std::cout << ", palettized in " << palettizeTime << "s";
+		std::cout << ", encoded in " << encodeTime << "s" << std::endl;
+		std::cout << counters.primaryRays << " primary, " << counters.shadowRays << " shadow and "
+				  << counters.reflectionRays << " reflection rays at " << raysPerSecond() / 1e6 << " Mrays/s" << std::endl;
+		std::cout << counters.intersectionTests << " intersection tests, " << counters.textureLookups << " texture lookups" << std::endl;
+	}
+
+	bool writeJSON(const std::string &path) const{
+		std::ofstream out(path);
+		if(!out)
+			return false;
+
+		out << "{\n";
+		out << "\t\"phases\": {\"sceneBuild\": " << sceneBuildTime << ", \"render\": " << renderTime
+			<< ", \"denoise\": " << denoiseTime << ", \"resolve\": " << resolveTime << ", \"palettize\": " << palettizeTime << ", \"encode\": " << encodeTime << "},\n";
+		out << "\t\"rays\": {\"primary\": " << counters.primaryRays << ", \"shadow\": " << counters.shadowRays
+			<< ", \"reflection\": " << counters.reflectionRays << ", \"total\": " << counters.totalRays()
+			<< ", \"perSecond\": " << (uint64_t)raysPerSecond() << "},\n";
+		out << "\t\"intersectionTests\": " << counters.intersectionTests << ",\n";
+		out << "\t\"textureLookups\": " << counters.textureLookups << ",\n";
+		out << "\t\"threads\": [";
+		for(u32 i = 0; i < threads.size(); i++){
+			out << (i ? ", " : "") << "{\"busy\": " << threads[i].busy << ", \"idle\": " << threads[i].idle << "}";
+		}
+		out << "]\n}\n";
+		return true;
+	}
+};
+
+RenderStats renderStats;
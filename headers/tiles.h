@@ -0,0 +1,140 @@
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <atomic>
+
+//Hands out square tiles of the image to the OpenMP team. Every thread
+//starts with its own contiguous run of tiles and takes them front to
+//back; once it runs dry it steals the back half of whoever has the most
+//left. Each queue is a packed (next, end) pair so both sides of a steal
+//agree through a single compare and swap.
+
+struct Tile{
+	u16 x0, y0, x1, y1;
+};
+
+//The image cut into tileSize squares, row by row. Tiles on the right and
+//bottom edges get cut short.
+std::vector<Tile> tileGrid(u16 width, u16 height, u16 tileSize){
+	std::vector<Tile> tiles;
+	tileSize = std::max<u16>(tileSize, 1);
+	for(u32 y = 0; y < height; y += tileSize){
+		for(u32 x = 0; x < width; x += tileSize){
+			tiles.push_back({(u16)x, (u16)y, (u16)std::min<u32>(x + tileSize, width), (u16)std::min<u32>(y + tileSize, height)});
+		}
+	}
+	return tiles;
+}
+
+int renderThreadCount(){
+#ifdef _OPENMP
+	return omp_get_max_threads();
+#else
+	return 1;
+#endif
+}
+
+int renderThreadIndex(){
+#ifdef _OPENMP
+	return omp_get_thread_num();
+#else
+	return 0;
+#endif
+}
+
+struct alignas(64) TileQueue{
+	std::atomic<uint64_t> range;
+
+	static uint64_t pack(u32 next, u32 end){
+		return ((uint64_t)end << 32) | next;
+	}
+};
+
+struct alignas(64) ThreadTime{
+	float busy = 0.0f;
+	u32 tiles = 0, steals = 0;
+};
+
+struct TileScheduler{
+	std::vector<Tile> tiles;
+	std::vector<TileQueue> queues;
+	std::vector<ThreadTime> times;
+
+	TileScheduler(u16 width, u16 height, u16 tileSize, int threads) : tiles(tileGrid(width, height, tileSize)), queues(threads), times(threads){
+		reset();
+	}
+
+	//Deals the tiles out again for another frame. The times keep adding up.
+	void reset(){
+		u32 threads = queues.size();
+		for(u32 i = 0; i < threads; i++){
+			u32 first = ((uint64_t)tiles.size() * i) / threads;
+			u32 last = ((uint64_t)tiles.size() * (i + 1)) / threads;
+			queues[i].range.store(TileQueue::pack(first, last));
+		}
+	}
+
+	//Grabs the next tile for this thread, stealing if its own queue is empty.
+	bool next(int thread, Tile &tile){
+		u32 index;
+		if(pop(thread, index) || steal(thread, index)){
+			tile = tiles[index];
+			times[thread].tiles++;
+			return true;
+		}
+		return false;
+	}
+
+	bool pop(int thread, u32 &index){
+		std::atomic<uint64_t> &range = queues[thread].range;
+		uint64_t current = range.load();
+		while(true){
+			u32 next = current, end = current >> 32;
+			if(next >= end)
+				return false;
+			if(range.compare_exchange_weak(current, TileQueue::pack(next + 1, end))){
+				index = next;
+				return true;
+			}
+		}
+	}
+
+	bool steal(int thread, u32 &index){
+		while(true){
+			//Go after whoever has the most work left.
+			int victim = -1;
+			u32 mostLeft = 0;
+			uint64_t victimRange = 0;
+			for(u32 i = 0; i < queues.size(); i++){
+				uint64_t current = queues[i].range.load();
+				u32 left = (u32)(current >> 32) - std::min((u32)current, (u32)(current >> 32));
+				if(left > mostLeft){
+					mostLeft = left;
+					victim = i;
+					victimRange = current;
+				}
+			}
+			if(victim < 0)
+				return false;
+
+			u32 next = victimRange, end = victimRange >> 32;
+			u32 taken = (mostLeft + 1) / 2;
+			if(!queues[victim].range.compare_exchange_strong(victimRange, TileQueue::pack(next, end - taken)))
+				continue;
+
+			//Render the first stolen tile right away and queue up the rest.
+			index = end - taken;
+			queues[thread].range.store(TileQueue::pack(end - taken + 1, end));
+			times[thread].steals++;
+			return true;
+		}
+	}
+
+	void printStats(float wallTime) const{
+		for(u32 i = 0; i < times.size(); i++){
+			float idle = std::max(0.0f, wallTime - times[i].busy);
+			std::cout << "Thread " << i << ": busy " << times[i].busy << "s, idle " << idle << "s, "
+					  << times[i].tiles << " tiles, " << times[i].steals << " steals" << std::endl;
+		}
+	}
+};
@@ -1,78 +1,145 @@
-bool sceneIntersection(Ray ray, std::vector<Object*> stuff, hitHistory &history){
-	float stuff_dist = std::numeric_limits<float>::max();
-	for(auto &object : stuff){
-		float dist_i = 0.0f;
-		if(object->intersect(ray, dist_i) && dist_i < stuff_dist){
-			stuff_dist = dist_i;
-			glm::vec3 hitPoint = ray.origin + ray.direction * dist_i;
-			hitHistory gotHist(dist_i, hitPoint, object->getNormal(hitPoint), object->material);
-			gotHist.UV = object->getUV(hitPoint);
-			history = gotHist;
-		}
-	}
-    return stuff_dist < std::numeric_limits<float>::max();
+#include "random.h"
+#include "sampling.h"
+#include "stats.h"
+#include "sphereStore.h"
+#include "bvh.h"
+#include "mesh.h"
+#include "scene.h"
+
+bool sceneIntersection(Ray ray, const Scene &scene, hitHistory &history){
+	PrimitiveHit hit;
+	if(!scene.intersect(ray, hit))
+		return false;
+	history = scene.surfaceAt(ray, hit);
+	return true;
 }
 
-glm::vec3 clampRay(glm::vec3 col){
-	glm::vec3 res = col;
-	res.x = col.x < 0 ? 0 : col.x > 1 ? 1 : col.x;
-	res.y = col.y < 0 ? 0 : col.y > 1 ? 1 : col.y;
-	res.z = col.z < 0 ? 0 : col.z > 1 ? 1 : col.z;
-	return res;
+bool sceneOcclusion(Ray ray, const Scene &scene, float maxDist){
+	return scene.occluded(ray, maxDist);
 }
 
-//Based off "I wrote a Raytracer for DOS, 16 VGA Colors" video by Bisqwit.
-//I switched the array for a resizable vector. Random generation
-//done by 64bit Mersenne Twister Engine.
-std::vector<glm::vec3> shadowSoft;
-void initShadowSoftness(u8 amount){
-	shadowSoft.resize(amount);
-	for(int i = 0; i < amount; i++){
-		shadowSoft.push_back(glm::vec3(2.0f * (disty(ultraRNG) - 0.5f), 2.0f * (disty(ultraRNG) - 0.5f), 2.0f * (disty(ultraRNG) - 0.5f)));
+//Everything the light loop needs from a hit, worked out once. The
+//albedo only gets looked up the first time a light sample actually
+//reaches the point, and is then shared by every other sample.
+struct ShadingPoint{
+	const hitHistory &hit;
+	const Texture &texture;
+	glm::vec3 outsidePoint, insidePoint;
+	glm::vec3 albedo;
+	bool albedoReady = false;
+
+	ShadingPoint(const hitHistory &h, const Texture &tex, float offset) : hit(h), texture(tex), 
+		outsidePoint(h.hitPoint + h.normal * offset), insidePoint(h.hitPoint - h.normal * offset) {}
+
+	glm::vec3 getAlbedo(){
+		if(!albedoReady){
+			threadCounters.textureLookups++;
+			albedo = textureColor(texture, hit.UV.x, hit.UV.y, hit.hitPoint);
+			albedoReady = true;
+		}
+		return albedo;
 	}
 };
 
-glm::vec3 cast_ray(Ray ray, std::vector<Object*> stuff, std::vector<Light*> lights, glm::vec3 background, u8 depth = 0) {
+//How far and how long a path is allowed to go.
+struct TraceSettings{
+	glm::vec3 background = glm::vec3(0.0f);
+	//Bounces after the camera ray. Anything past maxBounces can't show
+	//through a mirror anyway, and a cap keeps two facing mirrors with no
+	//cutoff from bouncing forever.
+	int maxDepth = 8;
+	static constexpr int maxBounces = 64;
+	//Paths whose throughput drops below this stop, since whatever they
+	//could still pick up would barely show.
+	float throughputCutoff = 0.05f;
+	//Instead of always stopping below the cutoff, keep going with a chance
+	//proportional to the throughput and boost the survivors to make up for it.
+	bool russianRoulette = false;
+	AreaLightSampler shadowSampler;
+	//Lights to shade with instead of the scene's own, for animations that
+	//move them around without touching the shared scene.
+	const std::vector<PointLight> *lights = nullptr;
+};
+
+//What the camera ray hit first, for the denoiser to tell edges by.
+//Mirrors and the background count as white, so their color is left
+//alone when the albedo gets divided out.
+struct SurfaceGuide{
+	glm::vec3 normal, albedo;
+	float depth;
+};
+
+//Distance used for rays that hit nothing, far enough off that the sky
+//never gets blended with anything in the scene.
+const float guideMissDepth = 1e4f;
+
+glm::vec3 cast_ray(Ray ray, const Scene &scene, const TraceSettings &settings, const PixelSample &pixelSample, SurfaceGuide *guide = nullptr) {
 	float numericalMinimum = 1e-4f;
 	glm::vec3 finalColor;
-	hitHistory rayHist;
-    if (depth > 8 || !sceneIntersection(ray, stuff, rayHist)) {
-        return background; // Nothing, you dummy.
-    }
-
-	switch(rayHist.obtMat->type){
-			case Standard:{
-				for(u32 i = 0; i < lights.size(); i++){
-					for(u8 z = 0; z < shadowSoft.size(); z++){
-						glm::vec3 lightDir = lights[i]->lightDirection(rayHist.hitPoint, shadowSoft[z]);
-						float lightDist = lights[i]->lightDistance(rayHist.hitPoint, shadowSoft[z]);
-						
-						Ray shadowRay(glm::dot(lightDir ,rayHist.normal) < 0 ? rayHist.hitPoint - rayHist.normal * numericalMinimum : rayHist.hitPoint + rayHist.normal * numericalMinimum, lightDir);
-						hitHistory shadowHist;
-						
-						if (sceneIntersection(shadowRay, stuff, shadowHist) && glm::length(shadowHist.hitPoint - shadowRay.origin) < lightDist){
-							continue;
-						}
-
-						glm::vec3 obtainedColor = rayHist.obtMat->diffuse->returnColor(rayHist.UV.x, rayHist.UV.y, rayHist.hitPoint);
-						float brightness = lights[i]->intensity * std::max(0.f, glm::dot(lightDir, rayHist.normal) / shadowSoft.size());
-						finalColor += (obtainedColor * lights[i]->color * brightness) / lights[i]->attenuation(lightDist);
+	glm::vec3 throughput(1.0f);
+
+	for(int depth = 0; ; depth++){
+		hitHistory rayHist;
+		if (depth > settings.maxDepth || !sceneIntersection(ray, scene, rayHist)) {
+			finalColor += throughput * settings.background; // Nothing, you dummy.
+			if(guide && depth == 0)
+				*guide = {glm::vec3(0.0f), glm::vec3(1.0f), guideMissDepth};
+			break;
+		}
+
+		const Material &material = scene.materials[rayHist.obtMat];
+		if(guide && depth == 0)
+			*guide = {rayHist.normal, glm::vec3(1.0f), rayHist.dist};
+		if(material.type == Standard){
+			ShadingPoint shade(rayHist, scene.textures[material.diffuse], numericalMinimum);
+			if(guide && depth == 0)
+				guide->albedo = shade.getAlbedo();
+			glm::vec3 directColor;
+			RandomStream rng = pixelSample.stream(depth);
+			const AreaLightSampler &shadowSampler = settings.shadowSampler;
+			for(const PointLight &light : settings.lights ? *settings.lights : scene.lights){
+				glm::vec3 rotation(rng.nextFloat(), rng.nextFloat(), rng.nextFloat());
+				for(u32 z = 0; z < shadowSampler.count(); z++){
+					glm::vec3 areaPoint = shadowSampler.offset(z, rotation);
+					glm::vec3 lightDir = light.lightDirection(rayHist.hitPoint, areaPoint);
+					float lightDist = light.lightDistance(rayHist.hitPoint, areaPoint);
+					
+					threadCounters.shadowRays++;
+					Ray shadowRay(glm::dot(lightDir ,rayHist.normal) < 0 ? shade.insidePoint : shade.outsidePoint, lightDir);
+					
+					if (sceneOcclusion(shadowRay, scene, lightDist)){
+						continue;
 					}
+
+					glm::vec3 obtainedColor = shade.getAlbedo();
+					float brightness = light.intensity * std::max(0.f, glm::dot(lightDir, rayHist.normal) / shadowSampler.count());
+					directColor += (obtainedColor * light.color * brightness) / light.attenuation(lightDist);
 				}
-				break;
 			}
-			case Reflective:{
-				glm::vec3 reflect_dir = glm::normalize(glm::reflect(ray.direction, rayHist.normal));
-    			glm::vec3 reflect_orig = glm::dot(reflect_dir, rayHist.normal) < 0 ? rayHist.hitPoint - rayHist.normal * numericalMinimum : 
-										rayHist.hitPoint + rayHist.normal * numericalMinimum;
-    			glm::vec3 reflect_color = cast_ray(Ray(reflect_orig, reflect_dir), stuff, lights, background, depth + 1);
+			finalColor += throughput * directColor;
+			break;
+		}
+
+		if(material.type != Reflective)
+			break;
 
-				finalColor += (reflect_color * rayHist.obtMat->reflectiveness);
+		throughput *= material.reflectiveness;
+		float strength = std::max(std::max(throughput.x, throughput.y), throughput.z);
+		if(strength < settings.throughputCutoff){
+			if(!settings.russianRoulette)
 				break;
-			}
-			default:
+			float survival = strength / settings.throughputCutoff;
+			if(pixelSample.stream(depth).nextFloat() >= survival)
 				break;
+			throughput /= survival;
+		}
+
+		glm::vec3 reflect_dir = glm::normalize(glm::reflect(ray.direction, rayHist.normal));
+		glm::vec3 reflect_orig = glm::dot(reflect_dir, rayHist.normal) < 0 ? rayHist.hitPoint - rayHist.normal * numericalMinimum : 
+								rayHist.hitPoint + rayHist.normal * numericalMinimum;
+		threadCounters.reflectionRays++;
+		ray = Ray(reflect_orig, reflect_dir);
 	}
 
-	return clampRay(finalColor);
+	return finalColor;
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include <chrono>
 #include <thread>
 #include <numeric>
+#include <fstream>
+#include <variant>
 
 #include <glm/glm.hpp>
 #define GLM_ENABLE_EXPERIMENTAL
@@ -22,8 +24,9 @@ typedef uint8_t u8;
 typedef uint16_t u16;
 typedef uint32_t u32;
 
-auto seed = std::chrono::system_clock::now().time_since_epoch().count();
-std::mt19937_64 ultraRNG(seed);
+//Only used while setting the scene up. Anything random inside the
+//render loop goes through RandomStream instead.
+std::mt19937_64 ultraRNG;
 
 std::uniform_real_distribution<float> disty(0.0f, 1.0f);
 std::uniform_real_distribution<float> distx(-5.0f, 5.0f);
@@ -41,32 +44,6 @@ int main(int argc, char** argv){
 	std::cout << "Created by Uneven Prankster!" << std::endl;
 	std::cout << std::endl << "Dithering like it's the 90's!" << std::endl;
 
-	std::vector<Texture*> textures;
-	//textures.push_back(new CheckerTexture(glm::vec3(0.4f, 0.2f, 0.2f), glm::vec3(0.1f), 10));
-	textures.push_back(new PerlinTexture(3.0f, 0.6f, 5));
-	textures.push_back(new ImageTexture("stdfloor.png"));
-	textures.push_back(new SolidTexture(glm::vec3(0.1f, 0.6f, 0.1f)));
-	textures.push_back(new SolidTexture(glm::vec3(0.1f, 0.2f, 0.7f)));
-	
-	std::vector<Material> mats;
-	mats.push_back(Material(textures[0], 0.95f, Standard));
-	mats.push_back(Material(textures[1], 0.0f, Standard));
-	mats.push_back(Material(textures[2], 0.7f, Reflective));
-	mats.push_back(Material(textures[3], 0.0f, Standard));
-	
-	std::vector<Object*> objects;
-	objects.push_back(new Plane(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), mats[1]));
-
-	for(int i = 0; i < 50; i++){
-		float sphereSize = disty(ultraRNG);
-		objects.push_back(new Sphere(glm::vec3(distx(ultraRNG), sphereSize, distz(ultraRNG)), sphereSize, mats[distMat(ultraRNG)]));
-	}
-	
-	std::vector<Light*> lights;
-	//lights.push_back(new SunLight(glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(0.7f, 0.7f, 0.0f), 1.0f));
-    lights.push_back(new PointLight(glm::vec3(0.6f, 4.0f, 5.0f), glm::vec3(0.9f, 0.2f, 0.3f), 2.0f));
-	lights.push_back(new PointLight(glm::vec3(4.2f, 4.3f, 2.0f), glm::vec3(0.4, 0.2f, 0.7f), 2.4f));
-
 	INIReader reader("options.ini");
 
     if (reader.ParseError() < 0) {
@@ -82,14 +59,109 @@ int main(int argc, char** argv){
 	u8 rChannels = reader.GetInteger("MainSettings", "Channels", 3);
 	u8 rSamples = reader.GetInteger("MainSettings", "Samples", 4);
 
-	initShadowSoftness(reader.GetInteger("MainSettings", "ShadowSamples", 4));
+	//Leaving the seed out picks a new one every run, like it used to. It's
+	//read as text since GetInteger's long is only 32 bits on MinGW.
+	uint64_t rSeed = std::chrono::system_clock::now().time_since_epoch().count();
+	std::string seedText = reader.Get("MainSettings", "Seed", "");
+	if(!seedText.empty()){
+		try{
+			rSeed = std::stoull(seedText, nullptr, 0);
+		}
+		catch(const std::exception&){
+			std::cout << "Seed " << seedText << " isn't a number, so this run picks its own." << std::endl;
+		}
+	}
+	ultraRNG.seed(rSeed);
+
+	PhaseTimer sceneTimer;
+	Scene scene;
+	//scene.textures.push_back(CheckerTexture(glm::vec3(0.4f, 0.2f, 0.2f), glm::vec3(0.1f), 10));
+	scene.textures.push_back(PerlinTexture(3.0f, 0.6f, 5));
+	scene.textures.push_back(ImageTexture("stdfloor.png"));
+	scene.textures.push_back(SolidTexture(glm::vec3(0.1f, 0.6f, 0.1f)));
+	scene.textures.push_back(SolidTexture(glm::vec3(0.1f, 0.2f, 0.7f)));
+	
+	scene.materials.push_back(Material(0, 0.95f, Standard));
+	scene.materials.push_back(Material(1, 0.0f, Standard));
+	scene.materials.push_back(Material(2, 0.7f, Reflective));
+	scene.materials.push_back(Material(3, 0.0f, Standard));
+	
+	scene.planes.push_back(Plane(glm::vec3(0.0f, 0.0f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1));
+
+	for(int i = 0; i < 50; i++){
+		float sphereSize = disty(ultraRNG);
+		scene.spheres.push_back(Sphere(glm::vec3(distx(ultraRNG), sphereSize, distz(ultraRNG)), sphereSize, distMat(ultraRNG)));
+	}
 	
+	//scene.lights.push_back(SunLight(glm::vec3(-0.2f, -1.0f, -0.3f), glm::vec3(0.7f, 0.7f, 0.0f), 1.0f));
+    scene.lights.push_back(PointLight(glm::vec3(0.6f, 4.0f, 5.0f), glm::vec3(0.9f, 0.2f, 0.3f), 2.0f));
+	scene.lights.push_back(PointLight(glm::vec3(4.2f, 4.3f, 2.0f), glm::vec3(0.4, 0.2f, 0.7f), 2.4f));
+
+	std::string modelPath = reader.Get("Model", "Path", "");
+	if(!modelPath.empty()){
+		glm::vec3 modelPosition(reader.GetReal("Model", "PositionX", 0.0f), 
+								reader.GetReal("Model", "PositionY", 0.0f), 
+								reader.GetReal("Model", "PositionZ", 0.0f));
+		u32 modelMaterial = std::min<u32>(reader.GetInteger("Model", "Material", 0), scene.materials.size() - 1);
+		Mesh model(modelPath, modelPosition, reader.GetReal("Model", "Scale", 1.0f), modelMaterial);
+		if(model.triangleCount() > 0){
+			model.printStats();
+			scene.meshes.push_back(std::move(model));
+		}
+	}
+
+	scene.build();
+	renderStats.sceneBuildTime = sceneTimer.elapsed();
+	scene.printStats();
+
 	Options userOpts(rName, Encode, rWidth, rHeight, rChannels, rSamples);
+	userOpts.tileSize = reader.GetInteger("MainSettings", "TileSize", 32);
+	userOpts.seed = rSeed;
+	ResolveSettings resolve;
+	resolve.tonemap = parseTonemap(reader.Get("Output", "Tonemap", "clamp"));
+	resolve.exposure = reader.GetReal("Output", "Exposure", 1.0f);
+	resolve.sRGB = reader.GetBoolean("Output", "SRGB", false);
+	userOpts.resolver = Resolver(resolve);
+	userOpts.halfFloat = reader.GetBoolean("Output", "HalfFloat", false);
+	userOpts.denoise.enabled = reader.GetBoolean("Denoise", "Enabled", false);
+	userOpts.denoise.iterations = std::clamp<long>(reader.GetInteger("Denoise", "Iterations", 5), 1, DenoiseSettings::maxIterations);
+	userOpts.denoise.colorSigma = reader.GetReal("Denoise", "ColorSigma", userOpts.denoise.colorSigma);
+	userOpts.denoise.normalSigma = reader.GetReal("Denoise", "NormalSigma", userOpts.denoise.normalSigma);
+	userOpts.denoise.depthSigma = reader.GetReal("Denoise", "DepthSigma", userOpts.denoise.depthSigma);
+	userOpts.denoise.albedoSigma = reader.GetReal("Denoise", "AlbedoSigma", userOpts.denoise.albedoSigma);
+	userOpts.pixelSampler = PixelSampler(parseSamplePattern(reader.Get("MainSettings", "SamplePattern", "sobol")), rSamples);
 
+	std::string lutPath;
 	if(reader.GetBoolean("Palette", "Palettized", false)){
-		userOpts.pal = Palette(reader.Get("Palette", "Path", "goof.gpl"));
-		userOpts.palette = true;
-		userOpts.renderName = "result.png";
+		std::string palettePath = reader.Get("Palette", "Path", "goof.gpl");
+		userOpts.pal = Palette(palettePath);
+		userOpts.pal.candidateCount = std::max<long>(reader.GetInteger("Palette", "Candidates", 16), 1);
+		userOpts.pal.mode = reader.Get("Palette", "Mode", "dither") == "nearest" ? Nearest : Dithered;
+		//Snapping to the nearest color is a quick tree query, so there's nothing to cache.
+		userOpts.pal.useLUT(userOpts.pal.mode == Dithered ? reader.GetInteger("Palette", "LUTBits", 6) : 0);
+		if(userOpts.pal.lut && reader.GetBoolean("Palette", "LUTCache", false)){
+			lutPath = palettePath + ".lut";
+			if(userOpts.pal.lut->load(lutPath, userOpts.pal.pal, userOpts.pal.candidateCount))
+				std::cout << "Loaded " << userOpts.pal.lut->filledCells() << " cached plans from " << lutPath << std::endl;
+		}
+		userOpts.palettizeTiles = reader.GetBoolean("Palette", "PalettizeTiles", true);
+		userOpts.palette = userOpts.pal.getNumColors() > 0;
+		if(!userOpts.palette)
+			std::cout << "Couldn't load any colors from " << palettePath << ", so the render won't be palettized." << std::endl;
+	}
+	if(userOpts.encodeType != "gif" && userOpts.encodeType != "png"){
+		std::cout << "Can't encode " << userOpts.encodeType << ", so this will be a png instead." << std::endl;
+		userOpts.encodeType = "png";
+	}
+	if(userOpts.encodeType == "gif" && !userOpts.palette){
+		std::cout << "GIFs need a palette, so this will be a png instead." << std::endl;
+		userOpts.encodeType = "png";
+	}
+	//The name always ends in whatever the file turned out to be.
+	std::string renderName = withExtension(userOpts.renderName, userOpts.encodeType);
+	if(renderName != userOpts.renderName){
+		std::cout << userOpts.renderName << " doesn't end in ." << userOpts.encodeType << ", so the render goes to " << renderName << " instead." << std::endl;
+		userOpts.renderName = renderName;
 	}
 
 	userOpts.camMan.position = glm::vec3(reader.GetReal("Camera", "PositionX", 0.0f), 
@@ -103,10 +175,83 @@ int main(int argc, char** argv){
 							   reader.GetReal("Camera", "RotationAxisY", 0.0f), 
 							   reader.GetReal("Camera", "RotationAxisZ", 0.0f));
 
-	userOpts.camMan.background = glm::vec3(0.0f);
+	userOpts.trace.background = glm::vec3(0.0f);
+	userOpts.trace.maxDepth = std::clamp<long>(reader.GetInteger("Tracing", "MaxDepth", 8), 0, TraceSettings::maxBounces);
+	userOpts.trace.throughputCutoff = reader.GetReal("Tracing", "ReflectionCutoff", 0.05f);
+	userOpts.trace.russianRoulette = reader.GetBoolean("Tracing", "RussianRoulette", false);
+	userOpts.trace.shadowSampler = AreaLightSampler(std::clamp<long>(reader.GetInteger("MainSettings", "ShadowSamples", 4), 1, AreaLightSampler::maxSamples));
 	
-	PNGEncode(objects, lights, userOpts);
+	userOpts.progressive.enabled = reader.GetBoolean("Progressive", "Enabled", false);
+	userOpts.progressive.passes = std::max<long>(reader.GetInteger("Progressive", "Passes", rSamples), 0);
+	userOpts.progressive.snapshotSeconds = reader.GetReal("Progressive", "SnapshotSeconds", 10.0f);
+	userOpts.progressive.snapshotPasses = std::max<long>(reader.GetInteger("Progressive", "SnapshotPasses", 0), 0);
+
+	userOpts.adaptive.enabled = reader.GetBoolean("Adaptive", "Enabled", false);
+	userOpts.adaptive.minSamples = std::max<long>(reader.GetInteger("Adaptive", "MinSamples", 2), 2);
+	userOpts.adaptive.maxSamples = std::max<long>(reader.GetInteger("Adaptive", "MaxSamples", 64), userOpts.adaptive.minSamples);
+	userOpts.adaptive.budget = reader.GetReal("Adaptive", "Budget", rSamples);
+	userOpts.adaptive.threshold = reader.GetReal("Adaptive", "Threshold", 0.005f);
+
+	u32 frameCount = std::max<long>(reader.GetInteger("Animation", "Frames", 1), 1);
+	if(frameCount > 1 && (userOpts.progressive.enabled || userOpts.adaptive.enabled))
+		std::cout << "Animations render every frame in one go, so Progressive and Adaptive are ignored." << std::endl;
+	else if(userOpts.progressive.enabled && userOpts.adaptive.enabled)
+		std::cout << "Adaptive sampling goes in passes of its own, so Progressive is ignored." << std::endl;
+
+	if(frameCount > 1){
+		Animation animation;
+		animation.frameCount = frameCount;
+		animation.frameDelay = reader.GetInteger("Animation", "FrameDelay", 4);
+		animation.looping = reader.GetBoolean("Animation", "Loop", true);
+
+		//The still camera and lights are where the animation starts from,
+		//unless a keyframe says otherwise for frame 0.
+		Keyframe key;
+		key.position = userOpts.camMan.position;
+		key.rotation = userOpts.camMan.rotation;
+		key.fov = userOpts.camMan.renderFov;
+		for(auto &light : scene.lights) key.lights.push_back(light.origin);
+		animation.addKey(key);
+
+		//[Keyframe1], [Keyframe2] and so on, until one is missing.
+		for(u32 k = 1; !reader.Get("Keyframe" + std::to_string(k), "Frame", "").empty(); k++){
+			std::string section = "Keyframe" + std::to_string(k);
+			key.frame = reader.GetInteger(section, "Frame", 0);
+			key.position = glm::vec3(reader.GetReal(section, "PositionX", key.position.x), 
+									 reader.GetReal(section, "PositionY", key.position.y), 
+									 reader.GetReal(section, "PositionZ", key.position.z));
+			key.rotation = reader.GetReal(section, "Rotation", key.rotation);
+			key.fov = glm::radians(reader.GetReal(section, "FOV", glm::degrees(key.fov)));
+			for(u32 i = 0; i < key.lights.size(); i++){
+				std::string light = "Light" + std::to_string(i + 1);
+				key.lights[i] = glm::vec3(reader.GetReal(section, light + "X", key.lights[i].x), 
+										  reader.GetReal(section, light + "Y", key.lights[i].y), 
+										  reader.GetReal(section, light + "Z", key.lights[i].z));
+			}
+			animation.addKey(key);
+		}
+
+		AnimationEncode(scene, userOpts, animation);
+	}
+	else if(userOpts.adaptive.enabled)
+		AdaptiveEncode(scene, userOpts);
+	else if(userOpts.progressive.enabled)
+		ProgressiveEncode(scene, userOpts);
+	else
+		PNGEncode(scene, userOpts);
+
+	if(userOpts.pal.lut){
+		std::cout << "Palette LUT has " << userOpts.pal.lut->filledCells() << " of " << userOpts.pal.lut->cellCount() << " cells filled." << std::endl;
+		if(!lutPath.empty() && !userOpts.pal.lut->save(lutPath, userOpts.pal.pal, userOpts.pal.candidateCount))
+			std::cout << "Couldn't write the palette LUT to " << lutPath << std::endl;
+	}
 	
+	renderStats.print();
+	std::string statsPath = reader.Get("MainSettings", "StatsFile", "");
+	if(!statsPath.empty() && !renderStats.writeJSON(statsPath)){
+		std::cout << "Couldn't write the stats to " << statsPath << std::endl;
+	}
+
 	std::cout << "A " << userOpts.encodeType << " has been written by the name of " << userOpts.renderName << std::endl;
 	
 	return 0;
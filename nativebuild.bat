@@ -0,0 +1,3 @@
+g++ -std=c++17 -Iglm -O3 -march=native -fopenmp main.cpp -o vaportrace.exe
+
+vaportrace
\ No newline at end of file
@@ -0,0 +1,7 @@
+g++ -std=c++17 -Iglm -O2 -fopenmp tests/allocations.cpp -o allocations_test.exe || exit /b 1
+allocations_test.exe || exit /b 1
+
+g++ -std=c++17 -Iglm -O2 -fopenmp tests/mixPlans.cpp -o mixPlans_test.exe || exit /b 1
+mixPlans_test.exe || exit /b 1
+g++ -std=c++17 -Iglm -O2 -march=native -fopenmp tests/mixPlans.cpp -o mixPlans_native_test.exe || exit /b 1
+mixPlans_native_test.exe || exit /b 1
@@ -0,0 +1,134 @@
+//Renders a tile through cast_ray with every heap allocation counted,
+//to keep the tracing hot path from allocating again.
+#include "testCommon.h"
+#include <atomic>
+#include <new>
+
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocations(0);
+
+//Every form of new and delete goes through the plain pair, so they all
+//agree on malloc and free, and on what gets counted. GCC still flags the
+//free once it inlines delete into code it saw call new, so that one
+//warning is off for the overrides only.
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size){
+	if(counting)
+		allocations++;
+	void* memory = malloc(size ? size : 1);
+	if(!memory)
+		throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept{
+	free(memory);
+}
+
+void* operator new[](size_t size){
+	return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept{
+	try{
+		return operator new(size);
+	}
+	catch(const std::bad_alloc&){
+		return nullptr;
+	}
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete[](void* memory) noexcept{
+	operator delete(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept{
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, size_t) noexcept{
+	operator delete(memory);
+}
+
+void operator delete(void* memory, const std::nothrow_t&) noexcept{
+	operator delete(memory);
+}
+
+void operator delete[](void* memory, const std::nothrow_t&) noexcept{
+	operator delete(memory);
+}
+
+#if defined(__GNUC__) && !defined(__clang__) && __GNUC__ >= 11
+#pragma GCC diagnostic pop
+#endif
+
+//A tetrahedron, so the mesh path gets traced too.
+const char* meshPath = "allocations_test.obj";
+
+void writeMesh(){
+	std::ofstream obj(meshPath);
+	obj << "v -1 0 -1\nv 1 0 -1\nv 0 0 1\nv 0 1.5 0\n";
+	obj << "f 1 2 3\nf 1 2 4\nf 2 3 4\nf 3 1 4\n";
+}
+
+int main(){
+	Scene scene;
+	scene.textures.push_back(PerlinTexture(3.0f, 0.6f, 5));
+	scene.textures.push_back(CheckerTexture(glm::vec3(0.4f, 0.2f, 0.2f), glm::vec3(0.1f), 10));
+	scene.textures.push_back(SolidTexture(glm::vec3(0.1f, 0.6f, 0.1f)));
+	scene.materials.push_back(Material(0, 0.95f, Standard));
+	scene.materials.push_back(Material(1, 0.0f, Standard));
+	scene.materials.push_back(Material(2, 0.7f, Reflective));
+
+	scene.planes.push_back(Plane(glm::vec3(0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1));
+	scene.disks.push_back(Disk(glm::vec3(2.0f, 0.01f, 0.0f), glm::vec3(0.0f, 1.0f, 0.0f), 1.0f, 0));
+	ultraRNG.seed(1337);
+	std::uniform_real_distribution<float> size(0.2f, 1.0f), spread(-4.0f, 4.0f);
+	for(int i = 0; i < 30; i++){
+		float radius = size(ultraRNG);
+		scene.spheres.push_back(Sphere(glm::vec3(spread(ultraRNG), radius, spread(ultraRNG)), radius, i % 3));
+	}
+	writeMesh();
+	scene.meshes.push_back(Mesh(meshPath, glm::vec3(0.0f, 0.0f, 2.0f), 1.0f, 2));
+	std::remove(meshPath);
+	scene.lights.push_back(PointLight(glm::vec3(0.6f, 4.0f, 5.0f), glm::vec3(0.9f, 0.2f, 0.3f), 2.0f));
+	scene.lights.push_back(PointLight(glm::vec3(4.2f, 4.3f, 2.0f), glm::vec3(0.4, 0.2f, 0.7f), 2.4f));
+	scene.build();
+
+	Options opts("allocations.png", "png", 64, 64, 3, 4);
+	opts.seed = 1337;
+	opts.camMan.position = glm::vec3(0.0f, 2.5f, 8.0f);
+	opts.camMan.rotationAxis = glm::vec3(1.0f, 0.0f, 0.0f);
+	opts.camMan.rotation = -15.0f;
+	opts.camMan.renderFov = glm::radians(60.0f);
+	opts.trace.shadowSampler = AreaLightSampler(4);
+	opts.pixelSampler = PixelSampler(Sobol, opts.renderSamples);
+	glm::mat3 rotMat = glm::rotate(glm::radians(opts.camMan.rotation), opts.camMan.rotationAxis);
+
+	Tile tile = {0, 0, opts.renderWidth, opts.renderHeight};
+	glm::vec3 total(0.0f);
+	SurfaceGuide guide;
+	counting = true;
+	for(int y = tile.y0; y < tile.y1; y++){
+		for(int x = tile.x0; x < tile.x1; x++){
+			for(u32 sample = 0; sample < opts.renderSamples; sample++){
+				total += tracePixelSample(scene, opts, rotMat, x, y, sample, &guide);
+			}
+		}
+	}
+	counting = false;
+
+	check(threadCounters.primaryRays == (uint64_t)opts.renderWidth * opts.renderHeight * opts.renderSamples, "every primary ray got traced");
+	check(threadCounters.shadowRays > 0 && threadCounters.reflectionRays > 0, "shadow and reflection rays got traced");
+	check(total.x + total.y + total.z > 0.0f, "the tile isn't black");
+	check(allocations == 0, "tracing a tile allocated " + std::to_string(allocations) + " times");
+	return finishTest("allocations");
+}
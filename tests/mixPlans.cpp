@@ -0,0 +1,144 @@
+//Checks the float batch kernels the plan search runs on against the
+//scalar double distCompare and mixingPenalty they stand in for, color
+//by color and plan by plan. Build it with and without -march=native to
+//cover both the AVX2 and the SSE paths.
+#include "testCommon.h"
+
+//Plans that differ are fine as long as they're a tie, since float and
+//double can order two equally good plans either way.
+const double penaltyTolerance = 1e-6;
+
+//The plan search the way it was before the batch kernels, over the
+//same candidates.
+MixPlan scalarPlan(const Palette &palette, TrueColor original){
+	MixPlan result = {{0, 0, 0, 0}, 0.0f};
+	double nearestPenalty = std::numeric_limits<double>::max();
+
+	uint8_t candidates[256];
+	uint32_t count = palette.tree.nearest(original, palette.candidateCount, candidates);
+	std::sort(candidates, candidates + count);
+
+	for(uint32_t c1 = 0; c1 < count; c1++){
+		for(uint32_t c2 = c1; c2 < count; c2++){
+			TrueColor color1 = palette.pal[candidates[c1]], color2 = palette.pal[candidates[c2]];
+			int ratio = 32;
+			if(color1 != color2){
+				ratio = ((color2.R != color1.R ? 299*64 * int(original.R - color1.R) / int(color2.R - color1.R) : 0)
+					+  (color2.G != color1.G ? 587*64 * int(original.G - color1.G) / int(color2.G - color1.G) : 0)
+					+  (color1.B != color2.B ? 114*64 * int(original.B - color1.B) / int(color2.B - color1.B) : 0))
+				/ ((color2.R != color1.R ? 299 : 0) + (color2.G != color1.G ? 587 : 0) + (color2.B != color1.B ? 114 : 0));
+				if(ratio < 0) ratio = 0; else if(ratio > 63) ratio = 63;
+			}
+			TrueColor rgb0(color1.R + ratio * (int)(color2.R - color1.R) / 64,
+						   color1.G + ratio * (int)(color2.G - color1.G) / 64,
+						   color1.B + ratio * (int)(color2.B - color1.B) / 64);
+
+			double penalty = original.mixingPenalty(rgb0, color1, color2, ratio / 64.0);
+			if(penalty < nearestPenalty){
+				nearestPenalty = penalty;
+				result = {{candidates[c1], candidates[c2], 0, 0}, ratio / 64.0f};
+			}
+			if(c1 == c2)
+				continue;
+
+			for(uint32_t c3 = 0; c3 < count; c3++){
+				if(c3 == c1 || c3 == c2)
+					continue;
+				TrueColor color3 = palette.pal[candidates[c3]];
+				rgb0 = TrueColor((color1.R + color2.R + color3.R * 2) / 4, (color1.G + color2.G + color3.G * 2) / 4, (color1.B + color2.B + color3.B * 2) / 4);
+				TrueColor triTone((color1.R + color2.R) / 2, (color1.G + color2.G) / 2, (color1.B + color2.B) / 2);
+				penalty = original.distCompare(rgb0) + color1.distCompare(color2) * 0.025 + triTone.distCompare(color3) * 0.025;
+				if(penalty < nearestPenalty){
+					nearestPenalty = penalty;
+					result = {{candidates[c3], candidates[c1], candidates[c2], candidates[c3]}, 4.0f};
+				}
+			}
+		}
+	}
+	return result;
+}
+
+//What a plan costs for original, in double.
+double planPenalty(const Palette &palette, TrueColor original, const MixPlan &plan){
+	if(plan.mixRatio == 4.0f){
+		TrueColor color1 = palette.pal[plan.colors[1]], color2 = palette.pal[plan.colors[2]], color3 = palette.pal[plan.colors[3]];
+		TrueColor rgb0((color1.R + color2.R + color3.R * 2) / 4, (color1.G + color2.G + color3.G * 2) / 4, (color1.B + color2.B + color3.B * 2) / 4);
+		TrueColor triTone((color1.R + color2.R) / 2, (color1.G + color2.G) / 2, (color1.B + color2.B) / 2);
+		return original.distCompare(rgb0) + color1.distCompare(color2) * 0.025 + triTone.distCompare(color3) * 0.025;
+	}
+	TrueColor color1 = palette.pal[plan.colors[0]], color2 = palette.pal[plan.colors[1]];
+	int ratio = (int)(plan.mixRatio * 64.0f + 0.5f);
+	TrueColor rgb0(color1.R + ratio * (int)(color2.R - color1.R) / 64,
+				   color1.G + ratio * (int)(color2.G - color1.G) / 64,
+				   color1.B + ratio * (int)(color2.B - color1.B) / 64);
+	return original.mixingPenalty(rgb0, color1, color2, ratio / 64.0);
+}
+
+bool samePlan(const MixPlan &a, const MixPlan &b){
+	if(a.mixRatio != b.mixRatio)
+		return false;
+	int used = a.mixRatio == 4.0f ? 4 : 2;
+	return std::equal(a.colors, a.colors + used, b.colors);
+}
+
+std::vector<TrueColor> testColors(){
+	std::vector<TrueColor> colors;
+	for(int r = 0; r < 256; r += 51){
+		for(int g = 0; g < 256; g += 51){
+			for(int b = 0; b < 256; b += 51) colors.push_back(TrueColor(r, g, b));
+		}
+	}
+	std::mt19937 rng(1337);
+	std::uniform_int_distribution<int> channel(0, 255);
+	for(int i = 0; i < 1500; i++) colors.push_back(TrueColor(channel(rng), channel(rng), channel(rng)));
+	return colors;
+}
+
+//distanceBatch against distCompare, for every palette color as the
+//target and every lane of the batch, so a lane that lands in the wrong
+//slot shows up.
+void checkDistances(const Palette &palette, std::string name){
+	ColorBatch batch;
+	for(uint32_t i = 0; i < palette.pal.size(); i++) batch.set(i, palette.pal[i]);
+	batch.count = palette.pal.size();
+
+	alignas(32) float out[ColorBatch::capacity];
+	double worst = 0.0;
+	for(TrueColor target : palette.pal){
+		distanceBatch(target, batch, out);
+		for(uint32_t i = 0; i < batch.count; i++){
+			worst = std::max(worst, fabs(out[i] - target.distCompare(palette.pal[i])));
+		}
+	}
+	check(worst < penaltyTolerance, name + ": distanceBatch is off from distCompare by " + std::to_string(worst));
+}
+
+void checkPlans(Palette &palette, std::string name, uint32_t candidates){
+	palette.candidateCount = candidates;
+	u32 differing = 0;
+	for(TrueColor color : testColors()){
+		MixPlan batched = palette.deviseColorPlan(color), scalar = scalarPlan(palette, color);
+		if(samePlan(batched, scalar))
+			continue;
+		differing++;
+		double batchedPenalty = planPenalty(palette, color, batched), scalarPenalty = planPenalty(palette, color, scalar);
+		check(fabs(batchedPenalty - scalarPenalty) < penaltyTolerance, name + ": plans for " + std::to_string(color.R) + " " + std::to_string(color.G) + " " +
+			  std::to_string(color.B) + " differ by " + std::to_string(batchedPenalty - scalarPenalty));
+	}
+	std::cout << name << " with " << candidates << " candidates: " << differing << " tied plans picked differently" << std::endl;
+}
+
+int main(){
+	for(std::string name : {"ega", "simplejpc-16", "splendor128", "vga"}){
+		Palette palette("palettes/" + name + ".gpl");
+		check(palette.getNumColors() > 0, "couldn't load palettes/" + name + ".gpl");
+		if(!palette.getNumColors())
+			continue;
+		checkDistances(palette, name);
+		checkPlans(palette, name, 16);
+	}
+	Palette vga("palettes/vga.gpl");
+	if(vga.getNumColors())
+		checkPlans(vga, "vga", 32);
+	return finishTest("mixPlans");
+}
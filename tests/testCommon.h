@@ -0,0 +1,50 @@
+//Everything main.cpp sets up before pulling the headers in, so a test
+//sees the renderer the same way. Each test is its own program and
+//returns EXIT_FAILURE if a check doesn't hold.
+#include <iostream>
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <limits>
+#include <string>
+#include <cstdlib>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <numeric>
+#include <fstream>
+#include <variant>
+
+#include <glm/glm.hpp>
+#define GLM_ENABLE_EXPERIMENTAL
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtx/transform.hpp>
+#include <glm/gtx/euler_angles.hpp>
+#include <glm/gtc/constants.hpp>
+
+typedef uint8_t u8;
+typedef uint16_t u16;
+typedef uint32_t u32;
+
+std::mt19937_64 ultraRNG;
+
+#include "../headers/objects.h"
+#include "../headers/encoding.h"
+
+int failures = 0;
+
+void check(bool condition, std::string what){
+	if(!condition){
+		std::cout << "FAILED: " << what << std::endl;
+		failures++;
+	}
+}
+
+int finishTest(std::string name){
+	if(failures)
+		std::cout << name << ": " << failures << " check(s) failed" << std::endl;
+	else
+		std::cout << name << ": ok" << std::endl;
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}